@@ -1,16 +1,104 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
 #include "astconsumer.h"
+#include "options.h"
 #include "ppcallbacks.h"
+#include "timereport.h"
 
 void SmokegenASTConsumer::Initialize(clang::ASTContext &ctx) {
-    ppCallbacks = new SmokegenPPCallbacks(ci.getPreprocessor());
+    ppCallbacks = new SmokegenPPCallbacks(ci.getPreprocessor(), enteredFiles);
     ci.getPreprocessor().addPPCallbacks(std::unique_ptr<SmokegenPPCallbacks>(ppCallbacks));
 }
 
 bool SmokegenASTConsumer::HandleTopLevelDecl(clang::DeclGroupRef DR) {
 
     for (clang::DeclGroupRef::iterator b = DR.begin(), e = DR.end(); b != e; ++b) {
+        // With a time report, the whole translation unit is visited in one
+        // go as well, so that parsing and visiting can be told apart.
+        if (modelLock || TimeReport::enabled) {
+            deferredDecls.push_back(*b);
+            continue;
+        }
         // Traverse the declaration using our AST visitor.
-        Visitor.TraverseDecl(*b);
+        traverseIfAllowed(*b);
     }
     return true;
 }
+
+void SmokegenASTConsumer::HandleTranslationUnit(clang::ASTContext &ctx) {
+    // QMutexLocker does nothing if modelLock is null
+    QMutexLocker locker(modelLock);
+    PhaseTimer timer("visit", QString::fromStdString(ci.getFrontendOpts().Inputs[0].getFile().str()));
+    for (clang::Decl* decl : deferredDecls) {
+        traverseIfAllowed(decl);
+    }
+    deferredDecls.clear();
+
+    // With -fmodules, an #include of a header covered by a module map
+    // becomes an import. The declarations it brings in are read from the
+    // module file and never get to HandleTopLevelDecl(), so they're picked
+    // up here. In umbrella mode, that's almost all of them.
+    if (ci.getLangOpts().Modules) {
+        for (clang::Decl* decl : ctx.getTranslationUnitDecl()->decls()) {
+            if (decl->getImportedOwningModule()) {
+                traverseIfAllowed(decl);
+            }
+        }
+    }
+    Visitor.populateReachableClasses();
+}
+
+void SmokegenASTConsumer::traverseIfAllowed(clang::Decl *D) {
+    if (clang::isa<clang::NamespaceDecl>(D) || clang::isa<clang::LinkageSpecDecl>(D)) {
+        for (clang::Decl* child : clang::cast<clang::DeclContext>(D)->decls()) {
+            traverseIfAllowed(child);
+        }
+        return;
+    }
+
+    // Declarations from elsewhere are still registered when they're
+    // referenced by a traversed one.
+    if (isInAllowedPath(D)) {
+        Visitor.TraverseDecl(D);
+    }
+}
+
+bool SmokegenASTConsumer::isInAllowedPath(const clang::Decl *D) {
+    if (ParserOptions::allowedPaths.isEmpty())
+        return true;
+
+    clang::SourceManager& sm = ci.getSourceManager();
+    clang::FileID fid = sm.getFileID(sm.getExpansionLoc(D->getLocation()));
+    auto cached = allowedFiles.find(fid);
+    if (cached != allowedFiles.end())
+        return cached->second;
+
+    // Declarations without a file, e.g. from the predefines, are kept.
+    bool allowed = true;
+    if (const clang::FileEntry* file = sm.getFileEntryForID(fid)) {
+        // The allowed paths have their symlinks resolved, so the real path
+        // is needed here, not the one the file was found by through -I.
+        QString path;
+        llvm::StringRef name = file->tryGetRealPathName();
+        if (!name.empty()) {
+            path = QDir::cleanPath(QString::fromStdString(name.str()));
+        } else {
+            QFileInfo info(QString::fromStdString(file->getName().str()));
+            path = info.canonicalFilePath();
+            if (path.isEmpty())
+                path = QDir::cleanPath(info.absoluteFilePath());
+        }
+
+        allowed = false;
+        foreach(const QString& prefix, ParserOptions::allowedPaths) {
+            if (path.startsWith(prefix)) {
+                allowed = true;
+                break;
+            }
+        }
+    }
+    allowedFiles[fid] = allowed;
+    return allowed;
+}
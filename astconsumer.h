@@ -1,12 +1,17 @@
 #ifndef SMOKEGEN_ASTCONSUMER
 #define SMOKEGEN_ASTCONSUMER
 
+#include <vector>
+
 #include <clang/AST/ASTConsumer.h>
 #include <clang/Frontend/CompilerInstance.h>
+#include <llvm/ADT/DenseMap.h>
 
 #include "astvisitor.h"
 
-class SmokegenPPCallbacks;
+#include "ppcallbacks.h"
+
+class QMutex;
 
 namespace clang {
     class ASTContext;
@@ -14,7 +19,8 @@ namespace clang {
 
 class SmokegenASTConsumer : public clang::ASTConsumer {
 public:
-    SmokegenASTConsumer(clang::CompilerInstance &ci) : ci(ci), Visitor(ci) {}
+    SmokegenASTConsumer(clang::CompilerInstance &ci, QMutex *modelLock = nullptr, UniqueFileSet *enteredFiles = nullptr)
+        : ci(ci), Visitor(ci), modelLock(modelLock), enteredFiles(enteredFiles) {}
 
     virtual void Initialize(clang::ASTContext &ctx) override;
 
@@ -22,10 +28,28 @@ public:
     // declaration.
     bool HandleTopLevelDecl(clang::DeclGroupRef DR) override;
 
+    void HandleTranslationUnit(clang::ASTContext &ctx) override;
+
 private:
+    // Traverses 'D' if it's located in one of ParserOptions::allowedPaths.
+    // Namespaces and linkage specifications are looked into, as their
+    // contents may come from several files.
+    void traverseIfAllowed(clang::Decl *D);
+    bool isInAllowedPath(const clang::Decl *D);
+
     SmokegenASTVisitor Visitor;
     clang::CompilerInstance &ci;
     SmokegenPPCallbacks *ppCallbacks;
+
+    // When parsing in parallel, the declarations are only collected while
+    // parsing and traversed in one go once the translation unit is complete,
+    // so the model lock is taken once per header.
+    QMutex *modelLock;
+    std::vector<clang::Decl*> deferredDecls;
+
+    UniqueFileSet *enteredFiles;
+
+    llvm::DenseMap<clang::FileID, bool> allowedFiles;
 };
 
 #endif
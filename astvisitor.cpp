@@ -1,11 +1,23 @@
-#include <regex>
 #include <iostream>
 
+#include <QSet>
+
 #include <clang/AST/ASTContext.h>
 #include <clang/Basic/Version.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringSwitch.h>
 
 #include "astvisitor.h"
-#include "defaultargvisitor.h"
+#include "defaultargprinter.h"
+#include "options.h"
+
+// Classes whose methods and fields have been registered in lazy mode. The
+// names are kept across translation units, so a class is only populated once.
+static QSet<QString> populatedClasses;
+
+void SmokegenASTVisitor::reset() {
+    populatedClasses.clear();
+}
 
 bool SmokegenASTVisitor::VisitCXXRecordDecl(clang::CXXRecordDecl *D) {
     registerClass(D);
@@ -96,27 +108,41 @@ Parameter SmokegenASTVisitor::toParameter(const clang::ParmVarDecl* param) const
         paramType
     );
 
-    
-
     if (const clang::Expr* defaultArgExpr = (param->hasUninstantiatedDefaultArg() ? param->getUninstantiatedDefaultArg() : param->getDefaultArg())) {
-        std::string defaultArgStr;
-        llvm::raw_string_ostream s(defaultArgStr);
-        defaultArgExpr->printPretty(s, nullptr, pp());
-        parameter.setDefaultValue(QString::fromStdString(s.str()));
-
-        DefaultArgVisitor argVisitor(ci);
-        argVisitor.TraverseStmt(const_cast<clang::Expr*>(defaultArgExpr));
-        std::string resolved = argVisitor.toString(defaultArgExpr);
-        if (!resolved.empty()) {
-            QString resolvedQString = QString::fromStdString(resolved);
-            resolvedQString = resolvedQString.replace(QRegExp("^=[\\s]*"), "");
-            parameter.setDefaultValue(resolvedQString);
-        }
+        parameter.setDefaultValue(QString::fromStdString(defaultArgPrinter.print(defaultArgExpr, pp())));
     }
 
     return parameter;
 }
 
+void SmokegenASTVisitor::populateReachableClasses() {
+    if (!ParserOptions::lazyClassRegistration)
+        return;
+
+    foreach (const QString& name, ParserOptions::classList) {
+        if (const clang::CXXRecordDecl* clangClass = classDecls.value(name)) {
+            reachableClasses.append(clangClass);
+        }
+    }
+
+    // Populating a class registers the types of its members, bases and
+    // fields, which adds any classes referenced by them to the worklist.
+    // Types registered before didn't add their classes, so they have to go
+    // through registerClass() again.
+    registeredTypes.clear();
+    collectReachableClasses = true;
+    while (!reachableClasses.isEmpty()) {
+        const clang::CXXRecordDecl* clangClass = reachableClasses.takeLast();
+        QString qualifiedName = QString::fromStdString(clangClass->getQualifiedNameAsString());
+        if (populatedClasses.contains(qualifiedName))
+            continue;
+        populatedClasses.insert(qualifiedName);
+        populateClass(&classes[qualifiedName], clangClass);
+    }
+    collectReachableClasses = false;
+    classDecls.clear();
+}
+
 Class* SmokegenASTVisitor::registerClass(const clang::CXXRecordDecl* clangClass) const {
     // We can't make bindings for things that don't have names.
     if (!clangClass->getDeclName())
@@ -131,6 +157,9 @@ Class* SmokegenASTVisitor::registerClass(const clang::CXXRecordDecl* clangClass)
     QString qualifiedName = QString::fromStdString(clangClass->getQualifiedNameAsString());
     if (classes.contains(qualifiedName) && !classes[qualifiedName].isForwardDecl()) {
         // We already have this class
+        if (ParserOptions::lazyClassRegistration && clangClass->hasDefinition()) {
+            noteClassDefinition(qualifiedName, clangClass);
+        }
         return &classes[qualifiedName];
     }
 
@@ -173,154 +202,172 @@ Class* SmokegenASTVisitor::registerClass(const clang::CXXRecordDecl* clangClass)
     }
 
     if (!isForward) {
-        if (!clangClass->getTypeForDecl()->isDependentType()) {
-            addQPropertyAnnotations(clangClass);
+        if (ParserOptions::lazyClassRegistration) {
+            noteClassDefinition(qualifiedName, clangClass);
+        } else {
+            populateClass(klass, clangClass);
+        }
+    }
+    return klass;
+}
 
-            // Set base classes
-            for (const clang::CXXBaseSpecifier& base : clangClass->bases()) {
-                const clang::CXXRecordDecl* baseRecordDecl = base.getType()->getAsCXXRecordDecl();
+void SmokegenASTVisitor::noteClassDefinition(const QString& qualifiedName, const clang::CXXRecordDecl* clangClass) const {
+    classDecls[qualifiedName] = clangClass;
+    if (collectReachableClasses) {
+        reachableClasses.append(clangClass);
+    }
+}
 
-                if (!baseRecordDecl) {
-                    // Ignore template specializations
-                    continue;
-                }
+void SmokegenASTVisitor::populateClass(Class* klass, const clang::CXXRecordDecl* clangClass) const {
+    if (!clangClass->getTypeForDecl()->isDependentType()) {
+        addQProperties(klass, clangClass);
 
-                Class::BaseClassSpecifier baseClass = Class::BaseClassSpecifier{
-                    &classes[QString::fromStdString(baseRecordDecl->getQualifiedNameAsString())],
-                    toAccess(base.getAccessSpecifier()),
-                    base.isVirtual()
-                };
+        // Set base classes
+        for (const clang::CXXBaseSpecifier& base : clangClass->bases()) {
+            const clang::CXXRecordDecl* baseRecordDecl = base.getType()->getAsCXXRecordDecl();
 
-                klass->appendBaseClass(baseClass);
+            if (!baseRecordDecl) {
+                // Ignore template specializations
+                continue;
             }
+
+            // Make sure the base is registered, it might not have been
+            // traversed if it's outside of the allowed paths.
+            Class* registeredBase = registerClass(baseRecordDecl);
+            Class::BaseClassSpecifier baseClass = Class::BaseClassSpecifier{
+                registeredBase ? registeredBase : &classes[QString::fromStdString(baseRecordDecl->getQualifiedNameAsString())],
+                toAccess(base.getAccessSpecifier()),
+                base.isVirtual()
+            };
+
+            klass->appendBaseClass(baseClass);
         }
+    }
 
-        // Set methods
-        QList<const clang::CXXMethodDecl*> methods;
+    // Set methods
+    QList<const clang::CXXMethodDecl*> methods;
 
-        for (auto method : clangClass->methods())
-            methods.append(method);
+    for (auto method : clangClass->methods())
+        methods.append(method);
 
-        for (const clang::CXXMethodDecl* method : methods) {
-            if (method->isImplicit()) {
-                continue;
-            }
+    for (const clang::CXXMethodDecl* method : methods) {
+        if (method->isImplicit()) {
+            continue;
+        }
 
-            clang::QualType clangReturnType = getReturnTypeForFunction(method);
+        clang::QualType clangReturnType = getReturnTypeForFunction(method);
 
-            if (klass->isTemplate() && clang::dyn_cast<clang::TemplateSpecializationType>(clangReturnType))
-                continue;
+        if (klass->isTemplate() && clang::dyn_cast<clang::TemplateSpecializationType>(clangReturnType))
+            continue;
 
-            Type* returnType = registerType(clangReturnType);
-            if (returnType->getTypedef()) {
-                returnType = typeFromTypedef(returnType->getTypedef(), returnType);
-            }
-            Method newMethod = Method(
-                klass,
-                QString::fromStdString(method->getNameAsString()),
-                returnType,
-                method->isDeleted() ? Access_private : toAccess(method->getAccess())
-            );
+        Type* returnType = registerType(clangReturnType);
+        if (returnType->getTypedef()) {
+            returnType = typeFromTypedef(returnType->getTypedef(), returnType);
+        }
+        Method newMethod = Method(
+            klass,
+            QString::fromStdString(method->getNameAsString()),
+            returnType,
+            method->isDeleted() ? Access_private : toAccess(method->getAccess())
+        );
 
 
-            newMethod.setIsDeleted(method->isDeleted());
+        newMethod.setIsDeleted(method->isDeleted());
 
 
-            // Avoid collecting methods we do not know how to call it.
-            // We need to collect some information about template classes but... take it easy...
-            if (klass->isTemplate() && newMethod.access() != Access_private)
-                continue;
+        // Avoid collecting methods we do not know how to call it.
+        // We need to collect some information about template classes but... take it easy...
+        if (klass->isTemplate() && newMethod.access() != Access_private)
+            continue;
 
-            for (auto attr_it = method->specific_attr_begin<clang::AnnotateAttr>();
-              attr_it != method->specific_attr_end<clang::AnnotateAttr>();
-              ++attr_it) {
-                const clang::AnnotateAttr *A = *attr_it;
-                if (A->getAnnotation() == "qt_signal") {
-                    newMethod.setIsSignal(true);
-                }
-                else if (A->getAnnotation() == "qt_slot") {
-                    newMethod.setIsSlot(true);
-                }
-                if (A->getAnnotation() == "qt_property") {
-                    newMethod.setIsQPropertyAccessor(true);
-                }
-            }
-            if (const clang::CXXConversionDecl* conversion = clang::dyn_cast<clang::CXXConversionDecl>(method)) {
-                newMethod.setName(QString::fromStdString("operator " + conversion->getConversionType().getAsString(pp())));
+        for (auto attr_it = method->specific_attr_begin<clang::AnnotateAttr>();
+          attr_it != method->specific_attr_end<clang::AnnotateAttr>();
+          ++attr_it) {
+            const clang::AnnotateAttr *A = *attr_it;
+            if (A->getAnnotation() == "qt_signal") {
+                newMethod.setIsSignal(true);
             }
-
-            if (const clang::CXXConstructorDecl* ctor = clang::dyn_cast<clang::CXXConstructorDecl>(method)) {
-                // if (!ctor->isDeleted() && clangClass->isAbstract()) continue;
-                newMethod.setIsConstructor(true);
-                if (ctor->getExplicitSpecifier().isExplicit()) {
-                    newMethod.setFlag(Member::Explicit);
-                }
+            else if (A->getAnnotation() == "qt_slot") {
+                newMethod.setIsSlot(true);
             }
-            else if (clang::isa<clang::CXXDestructorDecl>(method)) {
-                newMethod.setIsDestructor(true);
+            if (A->getAnnotation() == "qt_property") {
+                newMethod.setIsQPropertyAccessor(true);
             }
-            newMethod.setIsConst(method->isConst());
-            if (method->isVirtual()) {
-                newMethod.setFlag(Member::Virtual);
-                if (method->isPure()) {
-                    newMethod.setFlag(Member::PureVirtual);
-                }
+        }
+        if (const clang::CXXConversionDecl* conversion = clang::dyn_cast<clang::CXXConversionDecl>(method)) {
+            newMethod.setName(QString::fromStdString("operator " + conversion->getConversionType().getAsString(pp())));
+        }
+
+        if (const clang::CXXConstructorDecl* ctor = clang::dyn_cast<clang::CXXConstructorDecl>(method)) {
+            // if (!ctor->isDeleted() && clangClass->isAbstract()) continue;
+            newMethod.setIsConstructor(true);
+            if (ctor->getExplicitSpecifier().isExplicit()) {
+                newMethod.setFlag(Member::Explicit);
             }
-            if (method->isStatic()) {
-                newMethod.setFlag(Member::Static);
+        }
+        else if (clang::isa<clang::CXXDestructorDecl>(method)) {
+            newMethod.setIsDestructor(true);
+        }
+        newMethod.setIsConst(method->isConst());
+        if (method->isVirtual()) {
+            newMethod.setFlag(Member::Virtual);
+            if (method->isPure()) {
+                newMethod.setFlag(Member::PureVirtual);
             }
+        }
+        if (method->isStatic()) {
+            newMethod.setFlag(Member::Static);
+        }
 
-            bool foundNotCompatibleParameter = false;
-            for (const clang::ParmVarDecl* param : method->parameters()) {
-                if (klass->isTemplate() && clang::dyn_cast<clang::TemplateTypeParmType>(param->getType()))
-                {
-                    foundNotCompatibleParameter = true;
-                    break;
-                }
+        bool foundNotCompatibleParameter = false;
+        for (const clang::ParmVarDecl* param : method->parameters()) {
+            if (klass->isTemplate() && clang::dyn_cast<clang::TemplateTypeParmType>(param->getType()))
+            {
+                foundNotCompatibleParameter = true;
+                break;
+            }
 
-                // TODO handle RValue on functions xpto(type &&s)
-                if (clang::dyn_cast<clang::RValueReferenceType>(param->getType()))
-                {
-                    foundNotCompatibleParameter = true;
-                    break;
-                }
-                newMethod.appendParameter(toParameter(param));
+            // TODO handle RValue on functions xpto(type &&s)
+            if (clang::dyn_cast<clang::RValueReferenceType>(param->getType()))
+            {
+                foundNotCompatibleParameter = true;
+                break;
             }
+            newMethod.appendParameter(toParameter(param));
+        }
 
-            if (foundNotCompatibleParameter)
-                continue;
+        if (foundNotCompatibleParameter)
+            continue;
 
-            klass->appendMethod(newMethod, true);
-        }
+        klass->appendMethod(newMethod, true);
+    }
 
-        for (const clang::Decl* decl : clangClass->decls()) {
-            const clang::VarDecl* varDecl = clang::dyn_cast<clang::VarDecl>(decl);
-            const clang::FieldDecl* fieldDecl = clang::dyn_cast<clang::FieldDecl>(decl);
-            if (!varDecl && !fieldDecl) {
-                continue;
-            }
-            const clang::DeclaratorDecl* declaratorDecl = clang::dyn_cast<clang::DeclaratorDecl>(decl);
-            Type* fieldType = registerType(declaratorDecl->getType());
+    for (const clang::Decl* decl : clangClass->decls()) {
+        const clang::VarDecl* varDecl = clang::dyn_cast<clang::VarDecl>(decl);
+        const clang::FieldDecl* fieldDecl = clang::dyn_cast<clang::FieldDecl>(decl);
+        if (!varDecl && !fieldDecl) {
+            continue;
+        }
+        const clang::DeclaratorDecl* declaratorDecl = clang::dyn_cast<clang::DeclaratorDecl>(decl);
+        Type* fieldType = registerType(declaratorDecl->getType());
 
-            if (fieldType->getTypedef()) {
-                fieldType = typeFromTypedef(fieldType->getTypedef(), fieldType);
-            }
-            if (!fieldType->isValid()) {
-                continue;
-            }
-            Field field(
-                klass,
-                QString::fromStdString(declaratorDecl->getNameAsString()),
-                fieldType,
-                toAccess(declaratorDecl->getAccess())
-            );
-            if (varDecl) {
-                field.setFlag(Member::Static);
-            }
-            klass->appendField(field);
+        if (fieldType->getTypedef()) {
+            fieldType = typeFromTypedef(fieldType->getTypedef(), fieldType);
+        }
+        if (!fieldType->isValid()) {
+            continue;
         }
+        Field field(
+            klass,
+            QString::fromStdString(declaratorDecl->getNameAsString()),
+            fieldType,
+            toAccess(declaratorDecl->getAccess())
+        );
+        if (varDecl) {
+            field.setFlag(Member::Static);
+        }
+        klass->appendField(field);
     }
-    return klass;
 }
 
 Enum* SmokegenASTVisitor::registerEnum(const clang::EnumDecl* clangEnum) const {
@@ -420,6 +467,11 @@ Function* SmokegenASTVisitor::registerFunction(const clang::FunctionDecl* clangF
 Type* SmokegenASTVisitor::registerType(clang::QualType clangType) const {
     clang::QualType orig = clang::QualType(clangType);
 
+    auto registered = registeredTypes.find(orig);
+    if (registered != registeredTypes.end()) {
+        return registered->second;
+    }
+
     Type type;
 
     if (clangType->isReferenceType()) {
@@ -547,7 +599,11 @@ Type* SmokegenASTVisitor::registerType(clang::QualType clangType) const {
     else if (const clang::EnumDecl* clangEnum = clang::dyn_cast_or_null<clang::EnumDecl>(clangType->getAsTagDecl())) {
         type.setEnum(registerEnum(clangEnum));
     }
-    return Type::registerType(type);
+
+    // only inserted now, the recursive calls above may have grown the map
+    Type* result = Type::registerType(type);
+    registeredTypes[orig] = result;
+    return result;
 }
 
 Typedef* SmokegenASTVisitor::registerTypedef(const clang::TypedefNameDecl* clangTypedef) const {
@@ -603,45 +659,185 @@ Type* SmokegenASTVisitor::typeFromTypedef(const Typedef* tdef, const Type* sourc
     return Type::registerType(targetType);
 }
 
-void SmokegenASTVisitor::addQPropertyAnnotations(const clang::CXXRecordDecl* D) const {
+namespace {
+
+// A word or a single punctuation character of a Q_PROPERTY declaration, with
+// its offset, so the type can be cut out of the declaration as written.
+struct PropertyToken {
+    llvm::StringRef text;
+    size_t offset;
+};
+
+std::vector<PropertyToken> tokenizeProperty(llvm::StringRef text) {
+    std::vector<PropertyToken> tokens;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (llvm::isSpace(text[i])) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        if (llvm::isAlnum(text[i]) || text[i] == '_') {
+            while (i < text.size() && (llvm::isAlnum(text[i]) || text[i] == '_'))
+                ++i;
+        } else {
+            ++i;
+        }
+        tokens.push_back(PropertyToken{ text.slice(start, i), start });
+    }
+    return tokens;
+}
+
+bool isPropertyAttribute(llvm::StringRef word) {
+    return llvm::StringSwitch<bool>(word)
+        .Cases("READ", "WRITE", "MEMBER", "RESET", "NOTIFY", true)
+        .Cases("REVISION", "DESIGNABLE", "SCRIPTABLE", "STORED", "USER", true)
+        .Cases("BINDABLE", "CONSTANT", "FINAL", "REQUIRED", true)
+        .Default(false);
+}
+
+// Reads "<type> <name> READ <getter> WRITE <setter> ...", as in moc.
+bool parseProperty(llvm::StringRef text, Property* property) {
+    std::vector<PropertyToken> tokens = tokenizeProperty(text);
+
+    // the type and the name come before the first attribute, the type can
+    // contain anything but an attribute outside of template arguments
+    size_t attributes = 0;
+    int depth = 0;
+    for (; attributes < tokens.size(); ++attributes) {
+        llvm::StringRef token = tokens[attributes].text;
+        if (token == "<" || token == "(")
+            ++depth;
+        else if (token == ">" || token == ")")
+            --depth;
+        else if (depth == 0 && isPropertyAttribute(token))
+            break;
+    }
+    if (attributes < 2)
+        return false;
+    const PropertyToken& name = tokens[attributes - 1];
+    if (!llvm::isAlpha(name.text[0]) && name.text[0] != '_')
+        return false;
+    property->setName(QString::fromStdString(name.text.str()));
+    property->setTypeName(QString::fromStdString(text.substr(0, name.offset).trim().str()));
+
+    for (size_t i = attributes; i < tokens.size(); ++i) {
+        llvm::StringRef attribute = tokens[i].text;
+        if (attribute == "CONSTANT") {
+            property->setFlag(Property::Constant);
+            continue;
+        } else if (attribute == "FINAL") {
+            property->setFlag(Property::Final);
+            continue;
+        } else if (attribute == "REQUIRED") {
+            property->setFlag(Property::Required);
+            continue;
+        }
+
+        if (i + 1 >= tokens.size())
+            return false;
+        llvm::StringRef value = tokens[++i].text;
+        QString valueString = QString::fromStdString(value.str());
+        if (attribute == "READ") {
+            property->setRead(valueString);
+        } else if (attribute == "WRITE") {
+            property->setWrite(valueString);
+        } else if (attribute == "MEMBER") {
+            property->setMember(valueString);
+        } else if (attribute == "RESET") {
+            property->setReset(valueString);
+        } else if (attribute == "NOTIFY") {
+            property->setNotify(valueString);
+        } else if (attribute == "REVISION") {
+            // REVISION <n> or, since Qt 6, REVISION(<major>, <minor>)
+            if (value == "(") {
+                int revision = 0;
+                if (i + 1 < tokens.size() && !tokens[i + 1].text.getAsInteger(10, revision))
+                    property->setRevision(revision);
+                while (i < tokens.size() && tokens[i].text != ")")
+                    ++i;
+            } else {
+                int revision = 0;
+                if (!value.getAsInteger(10, revision))
+                    property->setRevision(revision);
+            }
+        } else if (attribute == "DESIGNABLE") {
+            if (value == "false")
+                property->setFlag(Property::NotDesignable);
+        } else if (attribute == "SCRIPTABLE") {
+            if (value == "false")
+                property->setFlag(Property::NotScriptable);
+        } else if (attribute == "STORED") {
+            if (value == "false")
+                property->setFlag(Property::NotStored);
+        } else if (attribute == "USER") {
+            if (value == "true")
+                property->setFlag(Property::User);
+        }
+        // BINDABLE <name> isn't of any use here
+    }
+    return true;
+}
+
+template<typename T>
+T* lookupMember(const clang::CXXRecordDecl* D, const QString& name) {
+    clang::ASTContext& ctx = D->getASTContext();
+    auto declName = ctx.DeclarationNames.getIdentifier(&ctx.Idents.get(name.toStdString()));
+    for (clang::NamedDecl* namedDecl : D->lookup(declName)) {
+        if (T* decl = clang::dyn_cast<T>(namedDecl))
+            return decl;
+    }
+    return nullptr;
+}
+
+}
+
+void SmokegenASTVisitor::addQProperties(Class* klass, const clang::CXXRecordDecl* D) const {
     clang::ASTContext* ctx = &ci.getASTContext();
     for (const auto& d : D->decls()) {
-        if (clang::StaticAssertDecl *S = llvm::dyn_cast<clang::StaticAssertDecl>(d) ) {
-            if (auto *E = llvm::dyn_cast<clang::UnaryExprOrTypeTraitExpr>(S->getAssertExpr())) {
-                if (clang::ParenExpr *PE = llvm::dyn_cast<clang::ParenExpr>(E->getArgumentExpr())) {
-                    llvm::StringRef key = S->getMessage()->getString();
-                    if (key == "qt_property") {
-                        clang::StringLiteral *Val = llvm::dyn_cast<clang::StringLiteral>(PE->getSubExpr());
-
-                        std::string propertyStr = Val->getString().str();
-                        std::smatch match;
-                        std::regex readRe("READ +([^ ]*)");
-
-                        if (std::regex_search(propertyStr, match, readRe)) {
-                            auto Name = ctx->DeclarationNames.getIdentifier(&ctx->Idents.get(llvm::StringRef(match[1])));
-                            auto lookup = D->lookup(Name);
-                            for (clang::NamedDecl* namedDecl : lookup) {
-                                if (clang::CXXMethodDecl* method = clang::dyn_cast<clang::CXXMethodDecl>(namedDecl)) {
-                                    auto annotate = clang::AnnotateAttr(*ctx, clang::AttributeCommonInfo(clang::SourceRange()), llvm::StringRef("qt_property")).clone(*ctx);
-                                    method->addAttr(annotate);
-                                }
-                            }
-                        }
+        clang::StaticAssertDecl *S = llvm::dyn_cast<clang::StaticAssertDecl>(d);
+        if (!S || !S->getMessage() || S->getMessage()->getString() != "qt_property")
+            continue;
+        auto *E = llvm::dyn_cast<clang::UnaryExprOrTypeTraitExpr>(S->getAssertExpr());
+        if (!E)
+            continue;
+        clang::ParenExpr *PE = llvm::dyn_cast<clang::ParenExpr>(E->getArgumentExpr());
+        clang::StringLiteral *Val = PE ? llvm::dyn_cast<clang::StringLiteral>(PE->getSubExpr()) : nullptr;
+        if (!Val)
+            continue;
+
+        Property property;
+        if (!parseProperty(Val->getString(), &property)) {
+            qWarning() << "couldn't parse Q_PROPERTY" << QString::fromStdString(Val->getString().str()) << "in" << klass->toString();
+            continue;
+        }
 
-                        std::regex writeRe("WRITE +([^ ]*)");
-                        if (std::regex_search(propertyStr, match, writeRe)) {
-                            auto Name = ctx->DeclarationNames.getIdentifier(&ctx->Idents.get(llvm::StringRef(match[1])));
-                            auto lookup = D->lookup(Name);
-                            for (clang::NamedDecl* namedDecl : lookup) {
-                                if (clang::CXXMethodDecl* method = clang::dyn_cast<clang::CXXMethodDecl>(namedDecl)) {
-                                    auto annotate = clang::AnnotateAttr(*ctx, clang::AttributeCommonInfo(clang::SourceRange()), llvm::StringRef("qt_property")).clone(*ctx);
-                                    method->addAttr(annotate);
-                                }
-                            }
-                        }
-                    }
+        // mark the accessors, see populateClass()
+        foreach (const QString& accessor, QStringList() << property.read() << property.write()) {
+            if (accessor.isEmpty())
+                continue;
+            auto Name = ctx->DeclarationNames.getIdentifier(&ctx->Idents.get(accessor.toStdString()));
+            for (clang::NamedDecl* namedDecl : D->lookup(Name)) {
+                if (clang::CXXMethodDecl* method = clang::dyn_cast<clang::CXXMethodDecl>(namedDecl)) {
+                    auto annotate = clang::AnnotateAttr(*ctx, clang::AttributeCommonInfo(clang::SourceRange()), llvm::StringRef("qt_property")).clone(*ctx);
+                    method->addAttr(annotate);
                 }
             }
         }
+
+        Type* type = 0;
+        if (!property.read().isEmpty()) {
+            if (const clang::CXXMethodDecl* getter = lookupMember<clang::CXXMethodDecl>(D, property.read()))
+                type = registerType(getReturnTypeForFunction(getter));
+        } else if (!property.member().isEmpty()) {
+            if (const clang::FieldDecl* field = lookupMember<clang::FieldDecl>(D, property.member()))
+                type = registerType(field->getType());
+        }
+        if (type && type->getTypedef()) {
+            type = typeFromTypedef(type->getTypedef(), type);
+        }
+        property.setType(type);
+
+        klass->appendProperty(property);
     }
 }
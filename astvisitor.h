@@ -4,24 +4,46 @@
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Sema/Sema.h>
+#include <llvm/ADT/DenseMap.h>
 
+#include <QHash>
+#include <QList>
+
+#include "defaultargprinter.h"
 #include "type.h"
 
 class SmokegenASTVisitor : public clang::RecursiveASTVisitor<SmokegenASTVisitor> {
 public:
-    SmokegenASTVisitor(clang::CompilerInstance &ci) : ci(ci) {}
+    SmokegenASTVisitor(clang::CompilerInstance &ci) : ci(ci), collectReachableClasses(false) {}
 
     bool VisitCXXRecordDecl(clang::CXXRecordDecl *D);
     bool VisitEnumDecl(clang::EnumDecl *D);
     bool VisitFunctionDecl(clang::FunctionDecl *D);
     bool VisitTypedefNameDecl(clang::TypedefNameDecl *D);
 
+    // Only declarations are registered. Don't descend into expressions and
+    // statements, like default arguments, initializers or function bodies.
+    // Whatever is needed from them is read from the declaration directly.
+    bool TraverseStmt(clang::Stmt *S, DataRecursionQueue *Queue = nullptr) { return true; }
+
+    // In lazy mode, classes are only registered by name while traversing.
+    // This registers the methods and fields of the classes in
+    // ParserOptions::classList and of all classes reachable from them, and
+    // has to be called once the translation unit has been traversed.
+    void populateReachableClasses();
+
+    // Forgets what's kept across translation units. Has to be called when
+    // the model is cleared to parse the headers again.
+    static void reset();
+
 private:
     clang::PrintingPolicy pp() const { return ci.getSema().getPrintingPolicy(); }
 
     clang::QualType getReturnTypeForFunction(const clang::FunctionDecl* function) const;
 
     Class* registerClass(const clang::CXXRecordDecl* clangClass) const;
+    void populateClass(Class* klass, const clang::CXXRecordDecl* clangClass) const;
+    void noteClassDefinition(const QString& qualifiedName, const clang::CXXRecordDecl* clangClass) const;
     Enum* registerEnum(const clang::EnumDecl* clangEnum) const;
     Function* registerFunction(const clang::FunctionDecl* clangFunction) const;
     Type* registerType(const clang::QualType clangType) const;
@@ -36,9 +58,24 @@ private:
     // qreal** somefunc() // returns a double**, but typedef resolves will just return double
     Type* typeFromTypedef(const Typedef* tdef, const Type* sourceType) const;
 
-    void addQPropertyAnnotations(const clang::CXXRecordDecl* D) const;
+    // Adds the Q_PROPERTY declarations of 'D' to 'klass' and marks their READ
+    // and WRITE methods as property accessors.
+    void addQProperties(Class* klass, const clang::CXXRecordDecl* D) const;
 
     clang::CompilerInstance &ci;
+
+    // shared by all parameters, see toParameter()
+    mutable DefaultArgPrinter defaultArgPrinter;
+
+    // The results of registerType() in this translation unit, by the type
+    // as written, sugar and qualifiers included.
+    mutable llvm::DenseMap<clang::QualType, Type*> registeredTypes;
+
+    // Lazy mode bookkeeping: the definitions seen in this translation unit
+    // and the ones still to be populated.
+    mutable QHash<QString, const clang::CXXRecordDecl*> classDecls;
+    mutable QList<const clang::CXXRecordDecl*> reachableClasses;
+    mutable bool collectReachableClasses;
 };
 
 #endif
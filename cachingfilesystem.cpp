@@ -0,0 +1,141 @@
+#include <QMutexLocker>
+
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Path.h>
+
+#include "cachingfilesystem.h"
+
+namespace {
+
+// Hands out the cached buffer without copying it. The buffer is owned by the
+// CachingFileSystem, which outlives every invocation using it.
+class CachedFileRef : public llvm::vfs::File {
+public:
+    CachedFileRef(const llvm::vfs::Status &status, const llvm::MemoryBuffer &buffer) : stat(status), buffer(buffer) {}
+
+    llvm::ErrorOr<llvm::vfs::Status> status() override { return stat; }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+    getBuffer(const llvm::Twine &name, int64_t fileSize, bool requiresNullTerminator, bool isVolatile) override {
+        return llvm::MemoryBuffer::getMemBuffer(buffer.getBuffer(), name.str(), requiresNullTerminator);
+    }
+
+    std::error_code close() override { return std::error_code(); }
+
+private:
+    llvm::vfs::Status stat;
+    const llvm::MemoryBuffer &buffer;
+};
+
+std::string normalizedPath(llvm::StringRef path) {
+    llvm::SmallString<256> normalized(path);
+    llvm::sys::path::remove_dots(normalized, true);
+    return normalized.str().str();
+}
+
+bool isModified(const llvm::vfs::Status &cached, const llvm::ErrorOr<llvm::vfs::Status> &current) {
+    return !current
+        || current->getUniqueID() != cached.getUniqueID()
+        || current->getLastModificationTime() != cached.getLastModificationTime()
+        || current->getSize() != cached.getSize();
+}
+
+}
+
+llvm::ErrorOr<llvm::vfs::Status> CachingFileSystem::status(const llvm::Twine &path) {
+    llvm::SmallString<256> key;
+    path.toVector(key);
+
+    {
+        QMutexLocker locker(&mutex);
+        auto it = statusCache.find(key);
+        if (it != statusCache.end())
+            return it->second;
+    }
+
+    // Don't block the other threads while waiting for the file system.
+    llvm::ErrorOr<llvm::vfs::Status> result = ProxyFileSystem::status(key);
+
+    QMutexLocker locker(&mutex);
+    return statusCache.try_emplace(key, result).first->second;
+}
+
+llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> CachingFileSystem::openFileForRead(const llvm::Twine &path) {
+    llvm::SmallString<256> key;
+    path.toVector(key);
+
+    {
+        QMutexLocker locker(&mutex);
+        auto it = fileCache.find(key);
+        if (it != fileCache.end())
+            return std::unique_ptr<llvm::vfs::File>(new CachedFileRef(it->second.status, *it->second.buffer));
+    }
+
+    auto file = ProxyFileSystem::openFileForRead(key);
+    if (!file)
+        return file;
+    auto stat = (*file)->status();
+    if (!stat)
+        return stat.getError();
+    auto buffer = (*file)->getBuffer(key);
+    if (!buffer)
+        return buffer.getError();
+    (*file)->close();
+
+    QMutexLocker locker(&mutex);
+    // If another thread was faster, its entry is used and ours is dropped.
+    CachedFile &cached = fileCache.try_emplace(key, CachedFile{ llvm::vfs::Status::copyWithNewName(*stat, key), std::move(*buffer) }).first->second;
+    return std::unique_ptr<llvm::vfs::File>(new CachedFileRef(cached.status, *cached.buffer));
+}
+
+void CachingFileSystem::forEachFile(llvm::function_ref<void(llvm::StringRef path, llvm::StringRef contents)> fn) {
+    QMutexLocker locker(&mutex);
+    for (const auto &entry : fileCache) {
+        fn(entry.first(), entry.second.buffer->getBuffer());
+    }
+}
+
+bool CachingFileSystem::refresh(llvm::ArrayRef<std::string> paths) {
+    QMutexLocker locker(&mutex);
+
+    llvm::StringSet<> forced;
+    for (const std::string &path : paths) {
+        forced.insert(normalizedPath(path));
+    }
+
+    bool changed = false;
+
+    // Erasing from a StringMap doesn't invalidate the other iterators.
+    for (auto it = fileCache.begin(); it != fileCache.end();) {
+        auto current = it++;
+        if (forced.count(normalizedPath(current->first()))
+            || isModified(current->second.status, ProxyFileSystem::status(current->first())))
+        {
+            fileCache.erase(current);
+            changed = true;
+        }
+    }
+
+    for (auto it = statusCache.begin(); it != statusCache.end();) {
+        auto current = it++;
+        if (forced.count(normalizedPath(current->first()))) {
+            statusCache.erase(current);
+            continue;
+        }
+
+        llvm::ErrorOr<llvm::vfs::Status> status = ProxyFileSystem::status(current->first());
+        if (!current->second) {
+            // A header that appeared might be found instead of another one.
+            if (status) {
+                statusCache.erase(current);
+                changed = true;
+            }
+        } else if (isModified(*current->second, status)) {
+            // Directories change whenever files are added to them, that alone
+            // doesn't matter.
+            statusCache.erase(current);
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,46 @@
+#ifndef SMOKEGEN_CACHINGFILESYSTEM
+#define SMOKEGEN_CACHINGFILESYSTEM
+
+#include <memory>
+
+#include <QMutex>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+// Remembers the result of every status() call, including failed ones, and the
+// contents of every file read through it. All clang invocations of a run share
+// one instance, so each file of the include tree is only stat'ed and read from
+// disk once. It's safe to use from several threads at the same time.
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+    CachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs) : ProxyFileSystem(std::move(fs)) {}
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) override;
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(const llvm::Twine &path) override;
+
+    // Calls 'fn' with the path and the contents of every file read so far.
+    void forEachFile(llvm::function_ref<void(llvm::StringRef path, llvm::StringRef contents)> fn);
+
+    // Forgets the files in 'paths' and everything that changed on disk since
+    // it was cached. Returns whether that affected anything a parse could
+    // have seen, i.e. a file that was read or one that didn't exist before.
+    // Must not be called while an invocation is using the file system, the
+    // buffers of the dropped files are freed.
+    bool refresh(llvm::ArrayRef<std::string> paths);
+
+private:
+    struct CachedFile {
+        llvm::vfs::Status status;
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+    };
+
+    QMutex mutex;
+    llvm::StringMap<llvm::ErrorOr<llvm::vfs::Status>> statusCache;
+    llvm::StringMap<CachedFile> fileCache;
+};
+
+#endif
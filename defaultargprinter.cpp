@@ -0,0 +1,37 @@
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "defaultargprinter.h"
+
+const std::string& DefaultArgPrinter::print(const clang::Expr* expr, const clang::PrintingPolicy& policy) {
+    this->policy = &policy;
+    buffer.clear();
+    llvm::raw_string_ostream s(buffer);
+    expr->printPretty(s, this, policy);
+    s.flush();
+    return buffer;
+}
+
+bool DefaultArgPrinter::handledStmt(clang::Stmt* stmt, llvm::raw_ostream& os) {
+    clang::DeclRefExpr* D = clang::dyn_cast<clang::DeclRefExpr>(stmt);
+    if (!D)
+        return false;
+    clang::EnumConstantDecl* enumConstant = clang::dyn_cast<clang::EnumConstantDecl>(D->getDecl());
+    if (!enumConstant)
+        return false;
+
+    // printed without the helper, a DeclRefExpr doesn't contain any other
+    // expressions
+    std::string enumStr;
+    llvm::raw_string_ostream s(enumStr);
+    D->printPretty(s, nullptr, *policy);
+    s.flush();
+
+    if (clang::NamedDecl* parent = clang::dyn_cast<clang::NamedDecl>(enumConstant->getDeclContext()->getParent())) {
+        std::string prefix = parent->getQualifiedNameAsString() + "::";
+        if (!llvm::StringRef(enumStr).startswith(prefix))
+            os << prefix;
+    }
+    os << enumStr;
+    return true;
+}
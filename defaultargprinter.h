@@ -0,0 +1,46 @@
+#ifndef SMOKEGEN_DEFAULTARGPRINTER
+#define SMOKEGEN_DEFAULTARGPRINTER
+
+#include <string>
+
+#include <clang/AST/Expr.h>
+#include <clang/AST/PrettyPrinter.h>
+
+// Prints default argument expressions, resolving the enums used in them to
+// their fully-qualified names. For example:
+//
+// class QTextCodec {
+//     enum ConversionFlag {
+//         DefaultConversion,
+//         IgnoreHeader = 0x1,
+//         FreeFunction = 0x2
+//     };
+//
+//     struct ConverterState {
+//         ConverterState(ConversionFlag f = DefaultConversion);
+//     };
+// };
+// In the above constructor for ConverterState, clang will identify the default
+// argument for the constructor as the string as written, "DefaultConversion".
+// However, when smoke generates bindings for that struct outside of the
+// QTextCodec base class, so looking up DefaultConversion will fail.  It needs
+// to be fully qualified as QTextCodec::DefaultConversion.
+//
+// The enum constants are qualified while the expression is pretty-printed, so
+// it's a single pass over the expression. One instance is meant to be reused
+// for all parameters.
+class DefaultArgPrinter : public clang::PrinterHelper {
+public:
+    DefaultArgPrinter() : policy(nullptr) {}
+
+    // The returned string is only valid until the next call.
+    const std::string& print(const clang::Expr* expr, const clang::PrintingPolicy& policy);
+
+    bool handledStmt(clang::Stmt* stmt, llvm::raw_ostream& os) override;
+
+private:
+    const clang::PrintingPolicy* policy;
+    std::string buffer;
+};
+
+#endif
@@ -2,13 +2,51 @@
 
 #include "frontendaction.h"
 #include "astconsumer.h"
+#include "ppcallbacks.h"
+#include "options.h"
 
-std::unique_ptr<clang::ASTConsumer>
-SmokegenFrontendAction::CreateASTConsumer(clang::CompilerInstance &CI, clang::StringRef file) {
+// Only declarations end up in the model, so unless asked otherwise, the
+// parser doesn't need to look at anything else.
+static void setUpDeclarationsOnly(clang::CompilerInstance &CI) {
     // Parsing function bodies can cause global template functions to be
     // instantiated unecessarily
-    CI.getFrontendOpts().SkipFunctionBodies = true;
+    CI.getFrontendOpts().SkipFunctionBodies = !ParserOptions::parseFunctionBodies;
+    // Typo correction is expensive and only improves error messages
+    CI.getLangOpts().SpellChecking = false;
+}
+
+static void setUpModuleBuilds(clang::CompilerInstance &CI) {
+    if (!CI.getLangOpts().Modules)
+        return;
+
+    CI.setGenModuleActionWrapper([](const clang::FrontendOptions &, std::unique_ptr<clang::FrontendAction> action) {
+        return std::unique_ptr<clang::FrontendAction>(new SmokegenModuleAction(std::move(action)));
+    });
+}
+
+bool SmokegenFrontendAction::BeginSourceFileAction(clang::CompilerInstance &CI) {
+    setUpDeclarationsOnly(CI);
+    setUpModuleBuilds(CI);
+    return true;
+}
+
+std::unique_ptr<clang::ASTConsumer>
+SmokegenFrontendAction::CreateASTConsumer(clang::CompilerInstance &CI, clang::StringRef file) {
     CI.getDiagnostics().setSeverity(clang::diag::warn_undefined_inline, clang::diag::Severity::Ignored, clang::SourceLocation());
 
-    return std::make_unique<SmokegenASTConsumer>(CI);
+    return std::make_unique<SmokegenASTConsumer>(CI, modelLock, enteredFiles);
+}
+
+bool SmokegenPCHAction::BeginSourceFileAction(clang::CompilerInstance &CI) {
+    setUpDeclarationsOnly(CI);
+    setUpModuleBuilds(CI);
+    CI.getPreprocessor().addPPCallbacks(std::make_unique<SmokegenPPCallbacks>(CI.getPreprocessor()));
+
+    return clang::GeneratePCHAction::BeginSourceFileAction(CI);
+}
+
+bool SmokegenModuleAction::BeginSourceFileAction(clang::CompilerInstance &CI) {
+    CI.getPreprocessor().addPPCallbacks(std::make_unique<SmokegenPPCallbacks>(CI.getPreprocessor()));
+
+    return clang::WrapperFrontendAction::BeginSourceFileAction(CI);
 }
@@ -4,13 +4,45 @@
 #include <clang/Frontend/FrontendActions.h>
 #include <clang/Frontend/CompilerInstance.h>
 
-struct Options;
+#include "ppcallbacks.h"
+
+class QMutex;
 
 // For each source file provided to the tool, a new FrontendAction is created.
 class SmokegenFrontendAction : public clang::ASTFrontendAction {
 public:
+    // If a 'modelLock' is given, the action may run concurrently with others.
+    // The model is then only touched while holding the lock.
+    // The files entered while parsing are recorded in 'enteredFiles'.
+    SmokegenFrontendAction(QMutex *modelLock = nullptr, UniqueFileSet *enteredFiles = nullptr)
+        : modelLock(modelLock), enteredFiles(enteredFiles) {}
+
+    bool BeginSourceFileAction(clang::CompilerInstance &CI) override;
+
     std::unique_ptr<clang::ASTConsumer>
     CreateASTConsumer(clang::CompilerInstance &CI, clang::StringRef file) override;
+
+private:
+    QMutex *modelLock;
+    UniqueFileSet *enteredFiles;
+};
+
+// Builds the precompiled header given with -pch. The PPCallbacks are installed
+// here as well, so the qobjectdefs.h injection ends up in the PCH.
+class SmokegenPCHAction : public clang::GeneratePCHAction {
+public:
+    bool BeginSourceFileAction(clang::CompilerInstance &CI) override;
+};
+
+// With -fmodules, clang builds the modules on its own, in a separate
+// CompilerInstance. This wraps the action used for that, so the modules get
+// the PPCallbacks, and with them the qobjectdefs.h injection, too.
+class SmokegenModuleAction : public clang::WrapperFrontendAction {
+public:
+    SmokegenModuleAction(std::unique_ptr<clang::FrontendAction> action)
+        : clang::WrapperFrontendAction(std::move(action)) {}
+
+    bool BeginSourceFileAction(clang::CompilerInstance &CI) override;
 };
 
 #endif
@@ -18,6 +18,7 @@
 */
 
 #include <QCoreApplication>
+#include <QDataStream>
 #include <QDir>
 #include <QFileInfo>
 #include <QHash>
@@ -32,7 +33,10 @@
 #include <type.h>
 
 #include "globals.h"
+#include "../../memoryreport.h"
 #include "../../options.h"
+#include "../../serialization.h"
+#include "../../timereport.h"
 
 QDir Options::outputDir = QDir::current();
 QList<QFileInfo> Options::headerList;
@@ -58,24 +62,48 @@ static void showUsage()
     "    -pm <comma-seperated list of parent modules>" << std::endl <<
     "    -st <comma-seperated list of types that should be munged to scalars>" << std::endl <<
     "    -vt <comma-seperated list of types that should be mapped to Smoke::t_voidp>" << std::endl <<
-    "    -L <directory containing parent libs> (parent smoke libs can be located in a <modulename> subdirectory>)" << std::endl;
+    "    -L <directory containing parent libs> (parent smoke libs can be located in a <modulename> subdirectory>)" << std::endl <<
+    "    -modules <comma-seperated list of smokeconfig files, one for each module to generate from the same headers>" << std::endl;
 }
 
-extern "C" Q_DECL_EXPORT
-int generate()
+static bool optionsParsed = false;
+static bool showHelp = false;
+static QFileInfo smokeConfig;
+static QStringList moduleConfigs;
+
+// Sets everything that can be configured back to the defaults.
+static void resetOptions()
+{
+    showHelp = false;
+    smokeConfig = QFileInfo();
+    moduleConfigs.clear();
+
+    Options::outputDir = QDir::current();
+    Options::headerList.clear();
+    Options::classList.clear();
+    Options::parts = 20;
+    Options::module = "qt";
+    Options::parentModules.clear();
+    Options::libDir = QDir();
+    Options::scalarTypes.clear();
+    Options::voidpTypes.clear();
+    Options::qtMode = false;
+    Options::excludeExpressions.clear();
+    Options::includeFunctionNames.clear();
+    Options::includeFunctionSignatures.clear();
+}
+
+// Reads the command line arguments into Options.
+static bool parseArguments()
 {
-    Options::headerList = ParserOptions::headerList;
-    
-    QFileInfo smokeConfig;
-    
     const QStringList& args = QCoreApplication::arguments();
     for (int i = 0; i < args.count(); i++) {
         if (  (args[i] == "-m" || args[i] == "-p" || args[i] == "-pm" || args[i] == "-o" ||
-               args[i] == "-st" || args[i] == "-vt" || args[i] == "-smokeconfig" || args[i] == "-L")
+               args[i] == "-st" || args[i] == "-vt" || args[i] == "-smokeconfig" || args[i] == "-L" || args[i] == "-modules")
             && i + 1 >= args.count())
         {
             qCritical() << "generator_smoke: not enough parameters for option" << args[i];
-            return EXIT_FAILURE;
+            return false;
         } else if (args[i] == "-m") {
             Options::module = args[++i];
         } else if (args[i] == "-p") {
@@ -83,7 +111,7 @@ int generate()
             Options::parts = args[++i].toInt(&ok);
             if (!ok) {
                 qCritical() << "generator_smoke: couldn't parse argument for option" << args[i - 1];
-                return EXIT_FAILURE;
+                return false;
             }
         } else if (args[i] == "-pm") {
             Options::parentModules = args[++i].split(',');
@@ -97,12 +125,20 @@ int generate()
             Options::outputDir = QDir(args[++i]);
         } else if (args[i] == "-L") {
             Options::libDir = QDir(args[++i]);
+        } else if (args[i] == "-modules") {
+            moduleConfigs = args[++i].split(',');
         } else if (args[i] == "-h" || args[i] == "--help") {
-            showUsage();
-            return EXIT_SUCCESS;
+            showHelp = true;
+            return true;
         }
     }
-    
+
+    return true;
+}
+
+// Reads the smoke config into Options, on top of the command line arguments.
+static void readConfig(const QFileInfo& smokeConfig)
+{
     if (smokeConfig.exists()) {
         QFile file(smokeConfig.filePath());
         file.open(QIODevice::ReadOnly);
@@ -209,7 +245,69 @@ int generate()
     } else {
         qWarning() << "Couldn't find config file" << smokeConfig.filePath();
     }
-    
+}
+
+// Reads the command line arguments and the smoke config into Options. With
+// -modules, the configs of the modules are read in generateModules().
+static bool parseOptions()
+{
+    optionsParsed = true;
+
+    if (!parseArguments())
+        return false;
+    if (!showHelp && moduleConfigs.isEmpty())
+        readConfig(smokeConfig);
+    return true;
+}
+
+// Sets up Options for the module described by 'config'.
+static void readModuleOptions(const QFileInfo& config)
+{
+    resetOptions();
+    parseArguments();
+    readConfig(config);
+}
+
+// Called by smokegen before parsing when it's run with -lazy, so only the
+// classes in the class list (and what they reference) are fully registered.
+extern "C" Q_DECL_EXPORT
+int configure()
+{
+    if (!parseOptions())
+        return EXIT_FAILURE;
+
+    if (moduleConfigs.isEmpty()) {
+        ParserOptions::classList = Options::classList;
+        return EXIT_SUCCESS;
+    }
+
+    // The headers are parsed once for all modules. The list keeps the order
+    // of the configs, it's part of the key of the model cache.
+    QStringList configs = moduleConfigs;
+    QStringList classList;
+    foreach (const QString& config, configs) {
+        readModuleOptions(QFileInfo(config));
+        classList += Options::classList;
+    }
+    classList.removeDuplicates();
+    ParserOptions::classList = classList;
+    return EXIT_SUCCESS;
+}
+
+// Called by "smokegen --serve" before generating again, usually from a new
+// model. The options are read again and nothing computed from the previous
+// model is kept.
+extern "C" Q_DECL_EXPORT
+void reset()
+{
+    optionsParsed = false;
+    resetOptions();
+    Util::clearCaches();
+}
+
+// Generates the module set up in Options from the current model.
+static int generateModule()
+{
     if (!Options::outputDir.exists()) {
         qWarning() << "output directoy" << Options::outputDir.path() << "doesn't exist; creating it...";
         QDir::current().mkpath(Options::outputDir.path());
@@ -236,12 +334,139 @@ int generate()
 
     qDebug() << "Generating SMOKE sources...";
     
+    PhaseTimer timer("generator", "SmokeDataFile");
     SmokeDataFile smokeData;
+    Util::addGeneratedModule(smokeData);
+    timer.restart("SmokeDataFile::write");
     smokeData.write();
+    timer.restart("SmokeClassFiles::write");
     SmokeClassFiles classFiles(&smokeData);
     classFiles.write();
-    
+
     qDebug() << "Done.";
     
     return EXIT_SUCCESS;
 }
+
+struct BatchModule
+{
+    QFileInfo config;
+    QString name;
+    QStringList parentModules;
+    QStringList classList;
+};
+
+// Generates all modules given with -modules from the one parsed model. Parents
+// are generated before their children, so that Util::preparse() can look at
+// what they contain in memory instead of loading their built libraries.
+static int generateModules()
+{
+    QStringList configs = moduleConfigs;
+    QList<BatchModule> modules;
+    QSet<QString> names;
+    foreach (const QString& config, configs) {
+        QFileInfo file(config);
+        if (!file.exists()) {
+            qCritical() << "generator_smoke: couldn't find module config" << config;
+            return EXIT_FAILURE;
+        }
+        readModuleOptions(file);
+        modules << BatchModule{ file, Options::module, Options::parentModules, Options::classList };
+        names << Options::module;
+    }
+
+    QList<BatchModule> sorted;
+    QSet<QString> generated;
+    while (!modules.isEmpty()) {
+        int next = 0;
+        for (; next < modules.count(); next++) {
+            bool ready = true;
+            foreach (const QString& parent, modules[next].parentModules) {
+                if (names.contains(parent) && !generated.contains(parent))
+                    ready = false;
+            }
+            if (ready)
+                break;
+        }
+        if (next == modules.count()) {
+            qCritical() << "generator_smoke: the parent modules of" << modules.first().name << "depend on each other";
+            return EXIT_FAILURE;
+        }
+        generated << modules[next].name;
+        sorted << modules.takeAt(next);
+    }
+
+    // Every module only includes the headers declaring its own classes, plus
+    // those that don't declare a class of any module (e.g. global functions).
+    QHash<QString, QSet<QString> > moduleFiles;
+    QSet<QString> classFiles;
+    foreach (const BatchModule& module, sorted) {
+        foreach (const QString& className, module.classList) {
+            Registry<Class>::const_iterator klass = classes.constFind(className);
+            if (klass == classes.constEnd() || klass->fileName().isEmpty())
+                continue;
+            QString file = QFileInfo(klass->fileName()).absoluteFilePath();
+            moduleFiles[module.name] << file;
+            classFiles << file;
+        }
+    }
+
+    // the generator adds to the model, so each module starts from a copy
+    QByteArray model;
+    {
+        QDataStream stream(&model, QIODevice::WriteOnly);
+        saveModel(stream);
+    }
+
+    for (int i = 0; i < sorted.count(); i++) {
+        const BatchModule& module = sorted[i];
+        if (i > 0) {
+            clearModel();
+            Util::clearCaches();
+            QDataStream stream(model);
+            if (!loadModel(stream)) {
+                qCritical() << "generator_smoke: couldn't restore the model for" << module.name;
+                return EXIT_FAILURE;
+            }
+        }
+
+        readModuleOptions(module.config);
+        foreach (const QFileInfo& header, ParserOptions::headerList) {
+            QString file = header.absoluteFilePath();
+            if (moduleFiles[module.name].contains(file) || !classFiles.contains(file))
+                Options::headerList << header;
+        }
+
+        if (generateModule() != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+extern "C" Q_DECL_EXPORT
+int generate()
+{
+    if (!optionsParsed && !parseOptions())
+        return EXIT_FAILURE;
+
+    if (showHelp) {
+        showUsage();
+        return EXIT_SUCCESS;
+    }
+
+    Util::generatedModules.clear();
+
+    int result;
+    if (moduleConfigs.isEmpty()) {
+        Options::headerList = ParserOptions::headerList;
+        result = generateModule();
+    } else {
+        result = generateModules();
+    }
+
+    if (MemoryReport::enabled)
+        Util::addCachesToMemoryReport();
+
+    return result;
+}
@@ -81,6 +81,15 @@ struct SmokeDataFile
     QHash<const Class*, QSet<const Method*> > declaredVirtualMethods;
 };
 
+// What Util::preparse() needs to know about a parent module that was generated
+// earlier in the same run (see -modules), instead of loading its library.
+struct GeneratedModule
+{
+    QStringList parentModules;
+    QSet<QString> methodNames;       // "Class::mungedName"
+    QSet<QString> methodSignatures;  // "Class::mungedName(argType,...)"
+};
+
 struct SmokeClassFiles
 {
     SmokeClassFiles(SmokeDataFile *data);
@@ -106,12 +115,15 @@ struct Util
     static QHash<QString, QString> typeMap;
     static QHash<const Method*, const Function*> globalFunctionMap;
     static QHash<const Method*, const Field*> fieldAccessors;
+    static QHash<QString, GeneratedModule> generatedModules;
     
     static bool isVirtualInheritancePath(const Class* desc, const Class* super);
     static QList<const Class*> superClassList(const Class* klass);
     static QList<const Class*> descendantsList(const Class* klass);
 
     static void preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, const QList<QString>& keys);
+    // Remembers the functions and enums of the module being generated in generatedModules.
+    static void addGeneratedModule(const SmokeDataFile& smokeData);
 
     static bool canClassBeInstanciated(const Class* klass);
     static bool canClassBeCopied(const Class* klass, QList<const Class*> list = QList<const Class*>());
@@ -139,6 +151,11 @@ struct Util
     static QList<const Method*> collectVirtualMethods(const Class* klass);
     static const Method* isVirtualOverriden(const Method& meth, const Class* klass);
     static QList<const Method*> virtualMethodsForClass(const Class* klass);
+
+    // Adds the sizes of the caches kept by the functions above to the memory report.
+    static void addCachesToMemoryReport();
+    // Empties those caches and the maps above, e.g. before generating from a new model.
+    static void clearCaches();
 };
 
 #endif
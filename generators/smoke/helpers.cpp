@@ -31,6 +31,7 @@
 #include <smoke.h>
 
 #include "globals.h"
+#include "../../memoryreport.h"
 #include "../../options.h"
 
 typedef void (*InitSmokeFn)();
@@ -38,6 +39,66 @@ typedef void (*InitSmokeFn)();
 QHash<QString, QString> Util::typeMap;
 QHash<const Method*, const Function*> Util::globalFunctionMap;
 QHash<const Method*, const Field*> Util::fieldAccessors;
+QHash<QString, GeneratedModule> Util::generatedModules;
+
+// Results of the Util functions of the same name, per class.
+static QHash<const Class*, QList<const Class*> > superClassCache;
+static QHash<const Class*, QList<const Class*> > descendantsClassCache;
+static QHash<const Class*, bool> canClassBeInstanciatedCache;
+static QHash<const Class*, bool> canClassBeCopiedCache;
+static QHash<const Class*, bool> hasClassVirtualDestructorCache;
+static QHash<const Class*, bool> hasClassPublicDestructorCache;
+static QHash<const Class*, QList<const Method*> > virtualMethodsForClassCache;
+
+template<typename T>
+static void addCacheToMemoryReport(const QString& name, const QHash<const Class*, QList<T> >& cache)
+{
+    qint64 size = MemoryReport::hashSize(cache);
+    foreach (const QList<T>& list, cache) {
+        size += MemoryReport::listSize(list);
+    }
+    MemoryReport::add("generator caches", name, cache.count(), size);
+}
+
+template<typename K, typename V>
+static void addCacheToMemoryReport(const QString& name, const QHash<K, V>& cache)
+{
+    MemoryReport::add("generator caches", name, cache.count(), MemoryReport::hashSize(cache));
+}
+
+void Util::clearCaches()
+{
+    superClassCache.clear();
+    descendantsClassCache.clear();
+    canClassBeInstanciatedCache.clear();
+    canClassBeCopiedCache.clear();
+    hasClassVirtualDestructorCache.clear();
+    hasClassPublicDestructorCache.clear();
+    virtualMethodsForClassCache.clear();
+
+    typeMap.clear();
+    globalFunctionMap.clear();
+    fieldAccessors.clear();
+}
+
+void Util::addCachesToMemoryReport()
+{
+    addCacheToMemoryReport("superClassList", superClassCache);
+    addCacheToMemoryReport("descendantsList", descendantsClassCache);
+    addCacheToMemoryReport("canClassBeInstanciated", canClassBeInstanciatedCache);
+    addCacheToMemoryReport("canClassBeCopied", canClassBeCopiedCache);
+    addCacheToMemoryReport("hasClassVirtualDestructor", hasClassVirtualDestructorCache);
+    addCacheToMemoryReport("hasClassPublicDestructor", hasClassPublicDestructorCache);
+    addCacheToMemoryReport("virtualMethodsForClass", virtualMethodsForClassCache);
+
+    qint64 typeMapSize = MemoryReport::hashSize(typeMap);
+    for (QHash<QString, QString>::const_iterator it = typeMap.constBegin(); it != typeMap.constEnd(); ++it) {
+        typeMapSize += MemoryReport::stringSize(it.key()) + MemoryReport::stringSize(it.value());
+    }
+    MemoryReport::add("generator caches", "Util::typeMap", typeMap.count(), typeMapSize);
+    addCacheToMemoryReport("Util::globalFunctionMap", globalFunctionMap);
+    addCacheToMemoryReport("Util::fieldAccessors", fieldAccessors);
+}
 
 // looks up the inheritance path from desc to super and sets 'virt' to true if it encounters a virtual base
 static bool isVirtualInheritancePathPrivate(const Class* desc, const Class* super, bool *virt)
@@ -61,8 +122,6 @@ bool Util::isVirtualInheritancePath(const Class* desc, const Class* super)
 
 QList<const Class*> Util::superClassList(const Class* klass)
 {
-    static QHash<const Class*, QList<const Class*> > superClassCache;
-
     QList<const Class*> ret;
     if (superClassCache.contains(klass))
         return superClassCache[klass];
@@ -77,12 +136,10 @@ QList<const Class*> Util::superClassList(const Class* klass)
 
 QList<const Class*> Util::descendantsList(const Class* klass)
 {
-    static QHash<const Class*, QList<const Class*> > descendantsClassCache;
-
     QList<const Class*> ret;
     if (descendantsClassCache.contains(klass))
         return descendantsClassCache[klass];
-    for (QHash<QString, Class>::const_iterator iter = classes.constBegin(); iter != classes.constEnd(); iter++) {
+    for (Registry<Class>::const_iterator iter = classes.constBegin(); iter != classes.constEnd(); iter++) {
         if (superClassList(&iter.value()).contains(klass))
             ret << &iter.value();
     }
@@ -157,7 +214,22 @@ static bool compareArgs(const Method& method, const Smoke::Method& smokeMethod,
     return true;
 }
 
-static bool isRepeating(const QList<Smoke*>& parentModules, const char* className, const Method& method) {
+static QString methodSignature(const QString& className, const Method& method) {
+    QStringList args;
+    foreach (const Parameter& param, method.parameters()) {
+        args << param.type()->toString();
+    }
+    return className + "::" + Util::mungedName(method) + '(' + args.join(",") + ')';
+}
+
+static bool isRepeating(const QList<Smoke*>& parentModules, const QList<const GeneratedModule*>& generatedParents,
+                        const char* className, const Method& method) {
+    QString signature = methodSignature(className, method);
+    foreach (const GeneratedModule* module, generatedParents) {
+        if (module->methodSignatures.contains(signature))
+            return true;
+    }
+
     QString mungedName = Util::mungedName(method).toLatin1();
     foreach (Smoke* smoke, parentModules) {
         Smoke::ModuleIndex methodIndex = smoke->findMethod(className, mungedName.toLatin1().constData());
@@ -182,12 +254,18 @@ static bool isRepeating(const QList<Smoke*>& parentModules, const char* classNam
 }
 
 // assuming that enums don't change between modules, checking for the first member only is sufficient
-static bool isRepeating(const QList<Smoke*>& parentModules, const char* className, const Enum& eNum) {
+static bool isRepeating(const QList<Smoke*>& parentModules, const QList<const GeneratedModule*>& generatedParents,
+                        const char* className, const Enum& eNum) {
     if (eNum.members().isEmpty())
         return false;
 
     const EnumMember& firstMember = eNum.members().first();
 
+    foreach (const GeneratedModule* module, generatedParents) {
+        if (module->methodNames.contains(QString(className) + "::" + firstMember.name()))
+            return true;
+    }
+
     foreach(Smoke *smoke, parentModules) {
         Smoke::ModuleIndex methodIndex = smoke->findMethod(className, firstMember.name().toLatin1().constData());
         if (methodIndex.index)
@@ -203,8 +281,26 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
     globalSpace.setKind(Class::Kind_Class);
     globalSpace.setIsNameSpace(true);
 
+    // Parents generated earlier in the same run haven't been built yet, they
+    // are looked at in memory. Their own parents have to be checked as well
+    // then, a loaded library takes care of that itself.
     QList<Smoke*> parentModules;
-    foreach (QString module, Options::parentModules) {
+    QList<const GeneratedModule*> generatedParents;
+    QStringList pendingModules = Options::parentModules;
+    QSet<QString> seenModules;
+    while (!pendingModules.isEmpty()) {
+        QString module = pendingModules.takeFirst();
+        if (seenModules.contains(module))
+            continue;
+        seenModules << module;
+
+        QHash<QString, GeneratedModule>::const_iterator generated = generatedModules.constFind(module);
+        if (generated != generatedModules.constEnd()) {
+            generatedParents << &generated.value();
+            pendingModules += generated->parentModules;
+            continue;
+        }
+
         Smoke *smoke = loadSmokeModule(module);
         if (smoke) {
             parentModules << smoke;
@@ -212,7 +308,7 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
     }
 
     // add all functions as methods to a class called 'QGlobalSpace' or a class that represents a namespace
-    for (QHash<QString, Function>::const_iterator it = functions.constBegin(); it != functions.constEnd(); it++) {
+    for (Registry<Function>::const_iterator it = functions.constBegin(); it != functions.constEnd(); it++) {
         const Function& fn = it.value();
 
         QString fnString = fn.toString(false);
@@ -245,7 +341,7 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
 
         Method meth = Method(parent, fn.name(), fn.type(), Access_public, fn.parameters());
         meth.setFlag(Method::Static);
-        if (isRepeating(parentModules, parent->name().toLatin1(), meth)) {
+        if (isRepeating(parentModules, generatedParents, parent->name().toLatin1(), meth)) {
             continue;
         }
         parent->appendMethod(meth);
@@ -264,7 +360,7 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
     }
 
     // all enums that don't have a parent are put under QGlobalSpace, too
-    for (QHash<QString, Enum>::iterator it = enums.begin(); it != enums.end(); it++) {
+    for (Registry<Enum>::iterator it = enums.begin(); it != enums.end(); it++) {
         Enum& e = it.value();
         if (!e.parent()) {
             Class* parent = &globalSpace;
@@ -277,7 +373,7 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
                     parent->setIsNameSpace(true);
                 }
             // else, see if it is already defined in a parent module
-            } else if (isRepeating(parentModules, parent->name().toLatin1(), e)) {
+            } else if (isRepeating(parentModules, generatedParents, parent->name().toLatin1(), e)) {
                 continue;
             }
             // Top-level enums have to be explicitly included
@@ -348,6 +444,12 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
                     continue;
                 addAccessorMethods(f, usedTypes);
             }
+            // the property table refers to the types of all properties, even
+            // if no emitted method uses them (e.g. MEMBER properties)
+            foreach (const Property& property, klass.properties()) {
+                if (property.type())
+                    (*usedTypes) << property.type();
+            }
         }
         foreach (BasicTypeDeclaration* decl, klass.children()) {
             Enum* e = 0;
@@ -374,11 +476,37 @@ void Util::preparse(QSet<Type*> *usedTypes, QSet<const Class*> *superClasses, co
     }
 }
 
+void Util::addGeneratedModule(const SmokeDataFile& smokeData)
+{
+    GeneratedModule& module = generatedModules[Options::module];
+    module = GeneratedModule();
+    module.parentModules = Options::parentModules;
+
+    // preparse() only checks functions and enums that end up in namespaces
+    // and QGlobalSpace, so nothing else is kept
+    foreach (const QString& key, smokeData.includedClasses) {
+        const Class& klass = classes[key];
+        if (!klass.isNameSpace())
+            continue;
+        foreach (const Method& meth, klass.methods()) {
+            module.methodNames << klass.name() + "::" + mungedName(meth);
+            module.methodSignatures << methodSignature(klass.name(), meth);
+        }
+        foreach (BasicTypeDeclaration* decl, klass.children()) {
+            const Enum* e = dynamic_cast<Enum*>(decl);
+            if (!e)
+                continue;
+            foreach (const EnumMember& member, e->members()) {
+                module.methodNames << klass.name() + "::" + member.name();
+            }
+        }
+    }
+}
+
 bool Util::canClassBeInstanciated(const Class* klass)
 {
-    static QHash<const Class*, bool> cache;
-    if (cache.contains(klass))
-        return cache[klass];
+    if (canClassBeInstanciatedCache.contains(klass))
+        return canClassBeInstanciatedCache[klass];
 
     bool ctorFound = false, publicCtorFound = false, privatePureVirtualsFound = false;
     foreach (const Method& meth, klass->methods()) {
@@ -397,16 +525,14 @@ bool Util::canClassBeInstanciated(const Class* klass)
     // because then it has a default one generated by the compiler.
     // If it has private pure virtuals, then it can't be instanstiated either.
     bool ret = ((publicCtorFound || !ctorFound) && !privatePureVirtualsFound);
-    cache[klass] = ret;
+    canClassBeInstanciatedCache[klass] = ret;
     return ret;
 }
 
 bool Util::canClassBeCopied(const Class* klass, QList<const Class*> list)
 {
-    static QHash<const Class*, bool> cache;
-
-    if (cache.contains(klass))
-        return cache[klass];
+    if (canClassBeCopiedCache.contains(klass))
+        return canClassBeCopiedCache[klass];
 
     bool allMembersCopiable = true;
     if (!list.contains(klass)) {
@@ -450,16 +576,15 @@ bool Util::canClassBeCopied(const Class* klass, QList<const Class*> list)
 
     // if the parent can be copied and we didn't find a private copy c'tor, the class is copiable
     bool ret = (parentCanBeCopied && !privateCopyCtorFound && allMembersCopiable);
-    cache[klass] = ret;
+    canClassBeCopiedCache[klass] = ret;
 
     return ret;
 }
 
 bool Util::hasClassVirtualDestructor(const Class* klass)
 {
-    static QHash<const Class*, bool> cache;
-    if (cache.contains(klass))
-        return cache[klass];
+    if (hasClassVirtualDestructorCache.contains(klass))
+        return hasClassVirtualDestructorCache[klass];
 
     bool virtualDtorFound = false;
     foreach (const Method& meth, klass->methods()) {
@@ -479,18 +604,17 @@ bool Util::hasClassVirtualDestructor(const Class* klass)
 
     // if the superclass has a virtual d'tor, then the descendants have one automatically, too
     bool ret = (virtualDtorFound || superClassHasVirtualDtor);
-    cache[klass] = ret;
+    hasClassVirtualDestructorCache[klass] = ret;
     return ret;
 }
 
 bool Util::hasClassPublicDestructor(const Class* klass)
 {
-    static QHash<const Class*, bool> cache;
-    if (cache.contains(klass))
-        return cache[klass];
+    if (hasClassPublicDestructorCache.contains(klass))
+        return hasClassPublicDestructorCache[klass];
 
     if (klass->isNameSpace()) {
-        cache[klass] = false;
+        hasClassPublicDestructorCache[klass] = false;
         return false;
     }
 
@@ -504,7 +628,7 @@ bool Util::hasClassPublicDestructor(const Class* klass)
         }
     }
 
-    cache[klass] = publicDtorFound;
+    hasClassPublicDestructorCache[klass] = publicDtorFound;
     return publicDtorFound;
 }
 
@@ -909,14 +1033,12 @@ static bool qListContainsMethodPointer(const QList<const Method*> list, const Me
 
 QList<const Method*> Util::virtualMethodsForClass(const Class* klass)
 {
-    static QHash<const Class*, QList<const Method*> > cache;
-
     // virtual method callbacks for classes that can't be instanstiated aren't useful
     if (!Util::canClassBeInstanciated(klass))
         return QList<const Method*>();
 
-    if (cache.contains(klass))
-        return cache[klass];
+    if (virtualMethodsForClassCache.contains(klass))
+        return virtualMethodsForClassCache[klass];
 
     QList<const Method*> ret;
 
@@ -941,7 +1063,7 @@ QList<const Method*> Util::virtualMethodsForClass(const Class* klass)
         }
     }
 
-    cache[klass] = ret;
+    virtualMethodsForClassCache[klass] = ret;
     return ret;
 }
 
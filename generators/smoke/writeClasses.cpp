@@ -29,6 +29,8 @@
 
 #include "globals.h"
 #include "../../options.h"
+#include "../../outputfile.h"
+#include "../../timereport.h"
 
 SmokeClassFiles::SmokeClassFiles(SmokeDataFile *data)
     : m_smokeData(data)
@@ -58,6 +60,7 @@ void SmokeClassFiles::write(const QList<QString>& keys)
     int count2 = count;
 
     for (int i = 0; i < Options::parts; i++) {
+        PhaseTimer timer("x_*.cpp", "x_" + QString::number(i + 1) + ".cpp");
         QSet<QString> includes;
         QString classCode;
         QTextStream classOut(&classCode);
@@ -71,8 +74,8 @@ void SmokeClassFiles::write(const QList<QString>& keys)
         }
 
         // create the file
-        QFile file(Options::outputDir.filePath("x_" + QString::number(i + 1) + ".cpp"));
-        file.open(QFile::ReadWrite | QFile::Truncate);
+        OutputFile file(Options::outputDir.filePath("x_" + QString::number(i + 1) + ".cpp"));
+        file.open(QIODevice::WriteOnly);
 
         QTextStream fileOut(&file);
 
@@ -102,7 +105,8 @@ void SmokeClassFiles::write(const QList<QString>& keys)
 
         fileOut << "\n}\n";
 
-        file.close();
+        fileOut.flush();
+        file.commit();
     }
 }
 
@@ -29,6 +29,8 @@
 
 #include "globals.h"
 #include "../../options.h"
+#include "../../outputfile.h"
+#include "../../timereport.h"
 
 uint qHash(const QVector<int> intList)
 {
@@ -41,7 +43,7 @@ SmokeDataFile::SmokeDataFile()
 {
     qDebug("preparing SMOKE data [%s]", qPrintable(Options::module));
 
-    for (QHash<QString, Class>::const_iterator iter = ::classes.constBegin(); iter != ::classes.constEnd(); iter++) {
+    for (Registry<Class>::const_iterator iter = ::classes.constBegin(); iter != ::classes.constEnd(); iter++) {
         if (Options::classList.contains(iter.key()) && !iter.value().isForwardDecl() && !iter.value().isTemplate()) {
             classIndex[iter.key()] = 1;
         }
@@ -50,7 +52,12 @@ SmokeDataFile::SmokeDataFile()
     // superclasses might be in different modules, still they need to be indexed for inheritanceList to work properly
     QSet<const Class*> superClasses;
     includedClasses = classIndex.keys();
-    Util::preparse(&usedTypes, &superClasses, includedClasses);  // collect all used types, add c'tors.. etc.
+    {
+        // a category of its own, it's nested in the "SmokeDataFile" phase and
+        // the totals of a category would count it twice
+        PhaseTimer timer("preparse", "Util::preparse");
+        Util::preparse(&usedTypes, &superClasses, includedClasses);  // collect all used types, add c'tors.. etc.
+    }
 
     // Collect the classes that are inherited by classes in this smoke module and provide virtual methods.
     // These classes need to be indexed as well.
@@ -74,7 +81,7 @@ SmokeDataFile::SmokeDataFile()
     }
 
     // if a class is used somewhere but not listed in the class list, mark it external
-    for (QHash<QString, Class>::iterator iter = ::classes.begin(); iter != ::classes.end(); iter++) {
+    for (Registry<Class>::iterator iter = ::classes.begin(); iter != ::classes.end(); iter++) {
         if (iter.value().isTemplate() || Options::voidpTypes.contains(iter.key()))
             continue;
 
@@ -184,14 +191,38 @@ QString SmokeDataFile::getTypeFlags(const Type *t, int *classIdx)
     return flags;
 }
 
+// Index of the method 'name' of 'klass' with 'numArgs' arguments in the methods
+// table, or 0 if there's none. A negative 'numArgs' accepts any number. Like
+// moc, accessors inherited from a base class are accepted as well.
+static int accessorIndex(const QHash<const Member*, int>& methodIdx, const Class* klass, const QString& name, int numArgs)
+{
+    if (name.isEmpty())
+        return 0;
+    foreach (const Method& meth, klass->methods()) {
+        if (meth.name() != name || (numArgs >= 0 && meth.parameters().count() != numArgs))
+            continue;
+        int idx = methodIdx.value(&meth, 0);
+        if (idx)
+            return idx;
+    }
+    foreach (const Class::BaseClassSpecifier& base, klass->baseClasses()) {
+        if (!base.baseClass)
+            continue;
+        int idx = accessorIndex(methodIdx, base.baseClass, name, numArgs);
+        if (idx)
+            return idx;
+    }
+    return 0;
+}
+
 void SmokeDataFile::write()
 {
     qDebug("writing out smokedata.cpp [%s]", qPrintable(Options::module));
-    QFile smokedata(Options::outputDir.filePath("smokedata.cpp"));
-    smokedata.open(QFile::ReadWrite | QFile::Truncate);
+    OutputFile smokedata(Options::outputDir.filePath("smokedata.cpp"));
+    smokedata.open(QIODevice::WriteOnly);
     QTextStream out(&smokedata);
-    QFile argNames(Options::outputDir.filePath(QString("%1.argnames.txt").arg(Options::module)));
-    argNames.open(QFile::ReadWrite | QFile::Truncate);
+    OutputFile argNames(Options::outputDir.filePath(QString("%1.argnames.txt").arg(Options::module)));
+    argNames.open(QIODevice::WriteOnly);
     QTextStream outArgNames(&argNames);
     foreach (const QFileInfo& file, Options::headerList)
         out << "#include <" << file.fileName() << ">\n";
@@ -202,6 +233,9 @@ void SmokeDataFile::write()
 
     out << "namespace " << smokeNamespaceName  << " {\n\n";
 
+    // every table written below is a phase of the time report
+    PhaseTimer table("smokedata.cpp", "cast");
+
     // write out Options::module_cast() function
     out << "static void *cast(void *xptr, Smoke::Index from, Smoke::Index to) {\n";
     out << "  switch(from) {\n";
@@ -253,6 +287,8 @@ void SmokeDataFile::write()
     out << "  }\n";
     out << "}\n\n";
 
+    table.restart("inheritanceList");
+
     // write out the inheritance list
     QHash<QVector<int>, int> inheritanceList;
     QHash<const Class*, int> inheritanceIndex;
@@ -301,10 +337,12 @@ void SmokeDataFile::write()
 
     Class& globalSpace = classes["QGlobalSpace"];
 
+    table.restart("xenum functions");
+
     // xenum functions
     out << "// These are the xenum functions for manipulating enum pointers\n";
     QSet<QString> enumClassesHandled;
-    for (QHash<QString, Enum>::const_iterator it = enums.constBegin(); it != enums.constEnd(); it++) {
+    for (Registry<Enum>::const_iterator it = enums.constBegin(); it != enums.constEnd(); it++) {
         if (!it.value().isValid())
             continue;
 
@@ -334,6 +372,8 @@ void SmokeDataFile::write()
         }
     }
 
+    table.restart("xcall functions");
+
     // xcall functions
     out << "\n// Those are the xcall functions defined in each x_*.cpp file, for dispatching method calls\n";
     for (QMap<QString, int>::const_iterator iter = classIndex.constBegin(); iter != classIndex.constEnd(); iter++) {
@@ -344,6 +384,8 @@ void SmokeDataFile::write()
         out << "void xcall_" << smokeClassName << "(Smoke::Index, void*, Smoke::Stack);\n";
     }
 
+    table.restart("classes");
+
     // classes table
     out << "\n// List of all classes\n";
     out << "// Name, external, index into inheritanceList, method dispatcher, enum dispatcher, class flags, size\n";
@@ -383,6 +425,8 @@ void SmokeDataFile::write()
     }
     out << "};\n\n";
 
+    table.restart("types");
+
     out << "// List of all types needed by the methods (arguments and return values)\n"
         << "// Name, class ID if arg is a class, and TypeId\n";
     out << "static Smoke::Type types[] = {\n";
@@ -408,15 +452,19 @@ void SmokeDataFile::write()
     }
     out << "};\n\n";
 
-    QFile typeDefsFile(Options::outputDir.filePath(QString("%1.typedefs.txt").arg(Options::module)));
-    typeDefsFile.open(QFile::ReadWrite | QFile::Truncate);
+    table.restart("typedefs.txt");
+
+    OutputFile typeDefsFile(Options::outputDir.filePath(QString("%1.typedefs.txt").arg(Options::module)));
+    typeDefsFile.open(QIODevice::WriteOnly);
     QTextStream outTypeDefs(&typeDefsFile);
 
     foreach (Typedef typeDef, typedefs.values()) {
         outTypeDefs << typeDef.toString() << ";" << typeDef.resolve().toString() << "\n";
     }
     outTypeDefs.flush();
-    typeDefsFile.close();
+    typeDefsFile.commit();
+
+    table.restart("argumentList");
 
     out << "static Smoke::Index argumentList[] = {\n";
     out << "    0,\t//0  (void)\n";
@@ -515,6 +563,8 @@ void SmokeDataFile::write()
 
     out << "};\n\n";
 
+    table.restart("methodNames");
+
     out << "// Raw list of all methods, using munged names\n";
     out << "static const char *methodNames[] = {\n";
     out << "    \"\",\t//0\n";
@@ -525,6 +575,8 @@ void SmokeDataFile::write()
     }
     out << "};\n\n";
 
+    table.restart("methods");
+
     out << "// (classId, name (index in methodNames), argumentList index, number of args, method flags, "
         << "return type (index in types), xcall() index)\n";
     out << "static Smoke::Method methods[] = {\n";
@@ -675,6 +727,8 @@ void SmokeDataFile::write()
 
     out << "};\n\n";
 
+    table.restart("ambiguousMethodList");
+
     out << "static Smoke::Index ambiguousMethodList[] = {\n";
     out << "    0,\n";
 
@@ -717,6 +771,8 @@ void SmokeDataFile::write()
 
     out << "};\n\n";
 
+    table.restart("methodMaps");
+
     int methodMapCount = 1;
     out << "// Class ID, munged name ID (index into methodNames), method def (see methods) if >0 or number of overloads if <0\n";
     out << "static Smoke::MethodMap methodMaps[] = {\n";
@@ -750,8 +806,63 @@ void SmokeDataFile::write()
 
     out << "};\n\n";
 
+    table.restart("properties");
+
+    int propertyCount = 1;
+    out << "// (classId, name, type (index in types), read, write, reset, notify (indices in methods), property flags)\n";
+    out << "static Smoke::Property properties[] = {\n";
+    out << "    { 0, 0, 0, 0, 0, 0, 0, 0 },\t// (no property)\n";
+
+    for (QMap<QString, int>::const_iterator iter = classIndex.constBegin(); iter != classIndex.constEnd(); iter++) {
+        Class* klass = &classes[iter.key()];
+        if (externalClasses.contains(klass))
+            continue;
+
+        // sorted by name, for Smoke::idProperty()
+        QMap<QString, const Property*> properties;
+        for (const Property& property : klass->properties()) {
+            properties[property.name()] = &property;
+        }
+
+        foreach (const Property* property, properties) {
+            QString flags = "0";
+            if (property->flags() & Property::Constant)
+                flags += "|Smoke::pf_constant";
+            if (property->flags() & Property::Final)
+                flags += "|Smoke::pf_final";
+            if (property->flags() & Property::Required)
+                flags += "|Smoke::pf_required";
+            if (property->flags() & Property::User)
+                flags += "|Smoke::pf_user";
+            if (!(property->flags() & Property::NotDesignable))
+                flags += "|Smoke::pf_designable";
+            if (!(property->flags() & Property::NotScriptable))
+                flags += "|Smoke::pf_scriptable";
+            if (!(property->flags() & Property::NotStored))
+                flags += "|Smoke::pf_stored";
+            flags.replace("0|", "");
+
+            out << "    {" << iter.value() << ", \"" << property->name() << "\", "
+                << typeIndex.value(property->type(), 0) << ", "
+                << accessorIndex(methodIdx, klass, property->read(), 0) << ", "
+                << accessorIndex(methodIdx, klass, property->write(), 1) << ", "
+                << accessorIndex(methodIdx, klass, property->reset(), 0) << ", "
+                << accessorIndex(methodIdx, klass, property->notify(), -1) << ", "
+                << flags << "},";
+
+            // comment
+            out << "\t//" << propertyCount << " " << klass->toString() << "::" << property->name()
+                << " (" << property->typeName() << ")\n";
+            propertyCount++;
+        }
+    }
+
+    out << "};\n\n";
+
     out << "}\n\n";
 
+    table.restart("init function");
+
     out << "extern \"C\" {\n\n";
 
     for (int j = 0; j < Options::parentModules.count(); j++) {
@@ -778,12 +889,15 @@ void SmokeDataFile::write()
     out << "        " << smokeNamespaceName << "::inheritanceList,\n";
     out << "        " << smokeNamespaceName << "::argumentList,\n";
     out << "        " << smokeNamespaceName << "::ambiguousMethodList,\n";
-    out << "        " << smokeNamespaceName << "::cast );\n";
+    out << "        " << smokeNamespaceName << "::cast,\n";
+    out << "        " << smokeNamespaceName << "::properties, " << propertyCount << " );\n";
     out << "    initialized = true;\n";
     out << "}\n\n";
     out << "void delete_" << Options::module << "_Smoke() { delete " << Options::module << "_Smoke; }\n\n";
     out << "}\n";
 
-    smokedata.close();
-    argNames.close();
+    out.flush();
+    smokedata.commit();
+    outArgNames.flush();
+    argNames.commit();
 }
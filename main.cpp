@@ -17,27 +17,54 @@
 */
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QElapsedTimer>
 #include <QList>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QLibrary>
+#include <QMutex>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
 
 #include <QtXml>
 
 #include <QtDebug>
 
+#include <atomic>
 #include <iostream>
 
 #include <clang/Tooling/Tooling.h>
+#include <llvm/Support/VirtualFileSystem.h>
 
+#include "astvisitor.h"
+#include "cachingfilesystem.h"
 #include "options.h"
 #include "config.h"
 #include "frontendaction.h"
 #include "embedded_includes.h"
+#include "memoryreport.h"
+#include "outputfile.h"
+#include "ppcallbacks.h"
+#include "serialization.h"
+#include "server.h"
+#include "timereport.h"
 
 
 typedef int (*GenerateFn)();
+typedef int (*ConfigureFn)();
+typedef void (*ResetFn)();
+
+// Path of the synthesized translation unit used in umbrella mode. It doesn't
+// exist on disk, the content is kept in the in-memory file system.
+static const char UmbrellaFileName[] = "/smokegen/umbrella.h";
 
 static void showUsage()
 {
@@ -45,17 +72,412 @@ static void showUsage()
     "Usage: smokegen [options] [-clangOptions [options]] -- <header files>" << std::endl <<
     "Possible command line options are:" << std::endl <<
     "    -I <include dir>" << std::endl <<
+    "    -allow <path prefix of the files to register declarations from, defaults to the include dirs>" << std::endl <<
     "    -d <path to file containing #defines>" << std::endl <<
     "    -dm <list of macros that should be ignored>" << std::endl <<
     "    -g <generator to use>" << std::endl <<
     "    -qt enables Qt-mode (special treatment of QFlags)" << std::endl <<
     "    -t resolve typedefs" << std::endl <<
+    "    -umbrella parse all headers in a single translation unit" << std::endl <<
+    "    -bodies parse function bodies, too (they are skipped by default)" << std::endl <<
+    "    -lazy only register the members of classes the generator asks for" << std::endl <<
+    "    -j <number of headers to parse in parallel>" << std::endl <<
+    "    -parseall parse every header, even if an earlier one already included it" << std::endl <<
+    "    -pch <header to precompile and load before each parsed header>" << std::endl <<
+    "    -modulecache <dir to keep clang modules in, enables -fmodules>" << std::endl <<
+    "    -cache <dir to keep the parsed model in for the next run>" << std::endl <<
+    "    --emit-model <file to write the parsed model to, instead of running a generator>" << std::endl <<
+    "    --model <model file written by --emit-model, used instead of parsing>" << std::endl <<
+    "    --time-report print the time spent in each phase of the run" << std::endl <<
+    "    --time-trace <file to write the time report to, for chrome://tracing>" << std::endl <<
+    "    --memory-report print the peak memory usage and the sizes of the model and caches" << std::endl <<
+    "    --serve <local socket to keep running on and answer regeneration requests>" << std::endl <<
+    "    --watch keep running and regenerate whenever one of the parsed headers changes" << std::endl <<
     "    -o <output dir>" << std::endl <<
     "    -config <config file>" << std::endl <<
     "    -clangOptions <flags to pass to the clang tool>" << std::endl <<
     "    -h shows this message" << std::endl;
 }
 
+// Runs a single clang invocation with 'action'. All files are looked up
+// through 'files', which may be shared by consecutive invocations.
+static bool runInvocation(const std::vector<std::string>& args, std::unique_ptr<clang::FrontendAction> action,
+                          clang::FileManager* files)
+{
+    PhaseTimer timer("parse", QString::fromStdString(args.back()));
+    clang::tooling::ToolInvocation inv(args, std::move(action), files);
+    return inv.run();
+}
+
+// Prints the time and memory reports and writes the trace, if they were asked
+// for.
+static void printReports(const QString& traceFile)
+{
+    if (TimeReport::enabled) {
+        TimeReport::print();
+        if (!traceFile.isEmpty() && !TimeReport::writeTrace(traceFile))
+            qWarning() << "couldn't write time trace to" << traceFile;
+    }
+
+    if (MemoryReport::enabled) {
+        MemoryReport::addModel();
+        MemoryReport::print();
+    }
+}
+
+// Watches the files read while parsing that are in one of the allowed paths,
+// i.e. the headers of the module rather than those of the system. Editors
+// often replace a file when saving it, which drops it from the watcher, so
+// this is called again after every parse.
+static void watchParsedFiles(QFileSystemWatcher& watcher, CachingFileSystem& fileSystem)
+{
+    QSet<QString> watched = watcher.files().toSet();
+    QStringList files;
+    fileSystem.forEachFile([&](llvm::StringRef path, llvm::StringRef) {
+        // resolved like in SmokegenASTConsumer::isInAllowedPath()
+        QFileInfo info(QString::fromStdString(path.str()));
+        QString file = info.canonicalFilePath();
+        if (file.isEmpty())
+            file = QDir::cleanPath(info.absoluteFilePath());
+        if (watched.contains(file))
+            return;
+        foreach (const QString& dir, ParserOptions::allowedPaths) {
+            if (file.startsWith(dir)) {
+                files << file;
+                watched << file;
+                break;
+            }
+        }
+    });
+    if (!files.isEmpty())
+        watcher.addPaths(files);
+}
+
+static int runGenerator(GenerateFn generate, const QString& traceFile)
+{
+    int result;
+    {
+        PhaseTimer timer("generate", "generate");
+        result = generate();
+    }
+    printReports(traceFile);
+    return result;
+}
+
+// Checks whether 'pch' is newer than every file it was built from. The list
+// of files is taken from the dependency file clang wrote alongside of it.
+static bool isPrecompiledHeaderUpToDate(const QString& pch)
+{
+    QFileInfo pchInfo(pch);
+    QFile depFile(pch + ".d");
+    if (!pchInfo.exists() || !depFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QString deps = QString::fromLocal8Bit(depFile.readAll());
+    depFile.close();
+    deps.remove("\\\r\n").remove("\\\n");
+    // skip the target, "<pch>: "
+    int start = deps.indexOf(": ");
+    if (start < 0)
+        return false;
+
+    QStringList files;
+    QString current;
+    for (int i = start + 2; i < deps.length(); i++) {
+        if (deps[i] == '\\' && i + 1 < deps.length() && deps[i + 1] == ' ') {
+            current += deps[++i];
+        } else if (deps[i].isSpace()) {
+            if (!current.isEmpty())
+                files << current;
+            current.clear();
+        } else {
+            current += deps[i];
+        }
+    }
+    if (!current.isEmpty())
+        files << current;
+
+    foreach(const QString& file, files) {
+        // embedded files only exist in memory
+        if (file.startsWith("/builtins/"))
+            continue;
+        QFileInfo info(file);
+        if (!info.exists() || info.lastModified() > pchInfo.lastModified())
+            return false;
+    }
+    return true;
+}
+
+// Returns the path to a precompiled version of 'header', building it first if
+// there's no up-to-date one yet. The file name is derived from 'args', which
+// contain the include dirs and the defines, so changing any of them leads to
+// a different PCH. Returns an empty string if building the PCH failed.
+static QString precompiledHeader(const QFileInfo& header, const std::vector<std::string>& args,
+                                 clang::FileManager* files)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(header.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(ParserOptions::parseFunctionBodies));
+    for (const std::string& arg : args) {
+        hash.addData(arg.c_str(), arg.size() + 1);
+    }
+
+    QDir dir(QDir::temp().filePath("smokegen"));
+    if (!dir.exists() && !dir.mkpath(".")) {
+        qCritical() << "couldn't create directory" << dir.path();
+        return QString();
+    }
+    QString pch = dir.filePath(header.completeBaseName() + '-' + hash.result().toHex().left(16) + ".pch");
+
+    if (isPrecompiledHeaderUpToDate(pch)) {
+        qDebug() << "using precompiled header" << pch;
+        return pch;
+    }
+
+    qDebug() << "building precompiled header" << pch;
+
+    std::vector<std::string> pchArgv(args);
+    pchArgv.push_back("-x");
+    pchArgv.push_back("c++-header");
+    pchArgv.push_back("-MD");
+    pchArgv.push_back("-MF");
+    pchArgv.push_back((pch + ".d").toStdString());
+    pchArgv.push_back("-o");
+    pchArgv.push_back(pch.toStdString());
+    pchArgv.push_back(header.absoluteFilePath().toStdString());
+    if (!runInvocation(pchArgv, std::make_unique<SmokegenPCHAction>(), files)) {
+        QFile::remove(pch + ".d");
+        return QString();
+    }
+
+    return pch;
+}
+
+// Version of the model cache files, bump this whenever the format of the
+// cache changes. The model itself carries its own format version.
+static const qint32 ModelCacheVersion = 2;
+
+// Returns the model cache file for this run. Its name is derived from
+// everything that affects parsing apart from the contents of the parsed
+// files: the clang arguments (include dirs, defines, clang options), the
+// headers and the parser options.
+static QString modelCacheFile(const QDir& dir, const std::vector<std::string>& args)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(ModelCacheVersion));
+    for (const std::string& arg : args) {
+        hash.addData(arg.c_str(), arg.size() + 1);
+    }
+    foreach(QFileInfo file, ParserOptions::headerList) {
+        hash.addData(file.absoluteFilePath().toUtf8() + '\0');
+    }
+    hash.addData(QStringList(ParserOptions::notToBeResolved).join(',').toUtf8() + '\0');
+    hash.addData(ParserOptions::dropMacros.join(',').toUtf8() + '\0');
+    hash.addData(ParserOptions::allowedPaths.join(',').toUtf8() + '\0');
+    hash.addData(QByteArray::number(ParserOptions::resolveTypedefs) + QByteArray::number(ParserOptions::qtMode)
+                 + QByteArray::number(ParserOptions::umbrellaMode) + QByteArray::number(ParserOptions::parseFunctionBodies)
+                 + QByteArray::number(ParserOptions::lazyClassRegistration));
+    if (ParserOptions::lazyClassRegistration) {
+        hash.addData(ParserOptions::classList.join(',').toUtf8());
+    }
+
+    return dir.filePath("model-" + hash.result().toHex().left(16) + ".cache");
+}
+
+// Loads the model from 'cacheFile' if none of the files that were read when
+// building it has changed since. Headers that would now be found before the
+// ones in the cache, because they were added to an earlier include dir, are
+// not noticed.
+static bool loadCachedModel(const QString& cacheFile)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    qint32 version;
+    QList<QPair<QString, QByteArray> > dependencies;
+    stream >> version;
+    if (version != ModelCacheVersion)
+        return false;
+    stream >> dependencies;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    for (const auto& dependency : dependencies) {
+        QFile dep(dependency.first);
+        if (!dep.open(QIODevice::ReadOnly)
+            || QCryptographicHash::hash(dep.readAll(), QCryptographicHash::Sha1) != dependency.second)
+        {
+            qDebug() << "model cache is out of date," << dependency.first << "changed";
+            return false;
+        }
+    }
+
+    if (!loadModel(stream)) {
+        qWarning() << "couldn't read model cache" << cacheFile;
+        return false;
+    }
+    return true;
+}
+
+// Writes the model to 'cacheFile', together with the hashes of all files read
+// through 'fileSystem'.
+static void saveCachedModel(const QString& cacheFile, CachingFileSystem& fileSystem)
+{
+    QList<QPair<QString, QByteArray> > dependencies;
+    fileSystem.forEachFile([&dependencies](llvm::StringRef path, llvm::StringRef contents) {
+        dependencies << qMakePair(QString::fromStdString(path.str()),
+                                  QCryptographicHash::hash(QByteArray::fromRawData(contents.data(), contents.size()), QCryptographicHash::Sha1));
+    });
+
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "couldn't write model cache" << cacheFile;
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << ModelCacheVersion << dependencies;
+    saveModel(stream);
+
+    if (!file.commit())
+        qWarning() << "couldn't write model cache" << cacheFile;
+}
+
+// Whether 'header' was entered while parsing one of the previous headers.
+// The declarations in there are in the model already then.
+static bool wasParsed(llvm::vfs::FileSystem& fileSystem, const UniqueFileSet& parsedFiles, const std::string& header)
+{
+    llvm::ErrorOr<llvm::vfs::Status> status = fileSystem.status(header);
+    return status && parsedFiles.count(status->getUniqueID());
+}
+
+// Parses one header on a worker thread of the pool. Each job has its own
+// FileManager and CompilerInstance, only the file system and the model are
+// shared. If 'parsedFiles' is given, it's guarded by 'modelLock' as well.
+class ParseJob : public QRunnable
+{
+public:
+    ParseJob(const std::vector<std::string>& args, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem,
+             QMutex* modelLock, UniqueFileSet* parsedFiles, std::atomic<bool>* failed)
+        : m_args(args), m_fileSystem(fileSystem), m_modelLock(modelLock), m_parsedFiles(parsedFiles), m_failed(failed) {}
+
+    void run() override
+    {
+        if (*m_failed)
+            return;
+
+        if (m_parsedFiles) {
+            QMutexLocker locker(m_modelLock);
+            if (wasParsed(*m_fileSystem, *m_parsedFiles, m_args.back())) {
+                qDebug() << "skipping" << QString::fromStdString(m_args.back()) << "- already included by another header";
+                return;
+            }
+        }
+
+        qDebug() << "parsing" << QString::fromStdString(m_args.back());
+
+        clang::FileManager files({ "." }, m_fileSystem);
+        files.Retain();
+        UniqueFileSet enteredFiles;
+        if (!runInvocation(m_args, std::make_unique<SmokegenFrontendAction>(m_modelLock, m_parsedFiles ? &enteredFiles : nullptr), &files)) {
+            *m_failed = true;
+            return;
+        }
+
+        if (m_parsedFiles) {
+            QMutexLocker locker(m_modelLock);
+            m_parsedFiles->insert(enteredFiles.begin(), enteredFiles.end());
+        }
+    }
+
+private:
+    std::vector<std::string> m_args;
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_fileSystem;
+    QMutex* m_modelLock;
+    UniqueFileSet* m_parsedFiles;
+    std::atomic<bool>* m_failed;
+};
+
+// Parses the headers in ParserOptions::headerList into the model, in a single
+// translation unit, on 'jobs' threads or one after the other.
+static bool parseHeaders(const std::vector<std::string>& Argv, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fileSystem,
+                         llvm::vfs::InMemoryFileSystem& memoryFileSystem, clang::FileManager* fileManager,
+                         int jobs, bool parseAll)
+{
+    if (ParserOptions::umbrellaMode) {
+        // Every header is only lexed and parsed once this way, no matter
+        // how many of the other listed headers include it.
+        std::string umbrella;
+        foreach(QFileInfo file, ParserOptions::headerList) {
+            umbrella += "#include \"" + file.absoluteFilePath().toStdString() + "\"\n";
+        }
+
+        qDebug() << "parsing" << ParserOptions::headerList.count() << "headers in a single translation unit";
+
+        memoryFileSystem.addFile(UmbrellaFileName, 0, llvm::MemoryBuffer::getMemBufferCopy(umbrella, UmbrellaFileName));
+
+        std::vector<std::string> umbrellaArgv(Argv);
+        umbrellaArgv.push_back(UmbrellaFileName);
+        if (!runInvocation(umbrellaArgv, std::make_unique<SmokegenFrontendAction>(), fileManager)) {
+            return false;
+        }
+    }
+    else if (jobs > 1) {
+        // The headers are parsed concurrently. Registering the declarations
+        // in the model is serialized by 'modelLock', so forward
+        // declarations get settled against definitions by registerClass()
+        // just like in the sequential case.
+        QMutex modelLock;
+        UniqueFileSet parsedFiles;
+        std::atomic<bool> failed(false);
+
+        QThreadPool pool;
+        pool.setMaxThreadCount(jobs);
+        // clang recurses deeply on some headers, don't rely on the
+        // platform's default stack size for secondary threads
+        pool.setStackSize(8 * 1024 * 1024);
+        foreach(QFileInfo file, ParserOptions::headerList) {
+            std::vector<std::string> headerArgv(Argv);
+            headerArgv.push_back(file.absoluteFilePath().toStdString());
+            pool.start(new ParseJob(headerArgv, fileSystem, &modelLock, parseAll ? nullptr : &parsedFiles, &failed));
+        }
+        pool.waitForDone();
+
+        if (failed) {
+            return false;
+        }
+    }
+    else {
+        // Convenience headers pull in most of the other listed headers,
+        // so remember what has been seen and don't parse anything twice.
+        UniqueFileSet parsedFiles;
+        foreach(QFileInfo file, ParserOptions::headerList) {
+            std::string header = file.absoluteFilePath().toStdString();
+
+            // this has already been parsed because it was included by some header
+            if (!parseAll && wasParsed(*fileSystem, parsedFiles, header)) {
+                qDebug() << "skipping" << file.absoluteFilePath() << "- already included by another header";
+                continue;
+            }
+
+            qDebug() << "parsing" << file.absoluteFilePath();
+
+            std::vector<std::string> headerArgv(Argv);
+            headerArgv.push_back(header);
+            if (!runInvocation(headerArgv, std::make_unique<SmokegenFrontendAction>(nullptr, parseAll ? nullptr : &parsedFiles), fileManager)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
     try
@@ -73,6 +495,16 @@ int main(int argc, char **argv)
         bool addHeaders = false;
         bool addClangOptions = false;
         bool hasCommandLineGenerator = false;
+        int jobs = 1;
+        bool parseAll = false;
+        QFileInfo pchHeader;
+        QString moduleCache;
+        QString cacheDir;
+        QString emitModelFile;
+        QString modelFile;
+        QString timeTrace;
+        QString serverName;
+        bool watch = false;
         QStringList classes;
 
         ParserOptions::notToBeResolved << "FILE";
@@ -83,8 +515,10 @@ int main(int argc, char **argv)
         };
 
         for (int i = 1; i < args.count(); i++) {
-            if ((args[i] == "-I" || args[i] == "-d" || args[i] == "-dm" ||
-                args[i] == "-g" || args[i] == "-config") && i + 1 >= args.count())
+            if ((args[i] == "-I" || args[i] == "-allow" || args[i] == "-d" || args[i] == "-dm" ||
+                args[i] == "-g" || args[i] == "-config" || args[i] == "-j" ||
+                args[i] == "-pch" || args[i] == "-modulecache" || args[i] == "-cache" || args[i] == "--emit-model" || args[i] == "--model" ||
+                args[i] == "--time-trace" || args[i] == "--serve") && i + 1 >= args.count())
             {
                 qCritical() << "not enough parameters for option" << args[i];
                 return EXIT_FAILURE;
@@ -92,6 +526,9 @@ int main(int argc, char **argv)
             if (args[i] == "-I") {
                 ParserOptions::includeDirs << QDir(args[++i]);
             }
+            else if (args[i] == "-allow") {
+                ParserOptions::allowedPaths << args[++i];
+            }
             else if (args[i] == "-config") {
                 configFile = QFileInfo(args[++i]);
             }
@@ -115,6 +552,57 @@ int main(int argc, char **argv)
             else if (args[i] == "-qt") {
                 ParserOptions::qtMode = true;
             }
+            else if (args[i] == "-umbrella") {
+                ParserOptions::umbrellaMode = true;
+            }
+            else if (args[i] == "-bodies") {
+                ParserOptions::parseFunctionBodies = true;
+            }
+            else if (args[i] == "-lazy") {
+                ParserOptions::lazyClassRegistration = true;
+            }
+            else if (args[i] == "-j") {
+                bool ok = false;
+                jobs = args[++i].toInt(&ok);
+                if (!ok || jobs < 1) {
+                    qCritical() << "couldn't parse argument for option" << args[i - 1];
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (args[i] == "-parseall") {
+                parseAll = true;
+            }
+            else if (args[i] == "-pch") {
+                pchHeader = QFileInfo(args[++i]);
+            }
+            else if (args[i] == "-modulecache") {
+                moduleCache = args[++i];
+            }
+            else if (args[i] == "-cache") {
+                cacheDir = args[++i];
+            }
+            else if (args[i] == "--emit-model") {
+                emitModelFile = args[++i];
+            }
+            else if (args[i] == "--model") {
+                modelFile = args[++i];
+            }
+            else if (args[i] == "--memory-report") {
+                MemoryReport::enabled = true;
+            }
+            else if (args[i] == "--time-report") {
+                TimeReport::enabled = true;
+            }
+            else if (args[i] == "--time-trace") {
+                TimeReport::enabled = true;
+                timeTrace = args[++i];
+            }
+            else if (args[i] == "--serve") {
+                serverName = args[++i];
+            }
+            else if (args[i] == "--watch") {
+                watch = true;
+            }
             else if (args[i] == "-clangOptions") {
                 addClangOptions = true;
             }
@@ -150,6 +638,15 @@ int main(int argc, char **argv)
                 else if (elem.tagName() == "qtMode") {
                     ParserOptions::qtMode = (elem.text() == "true");
                 }
+                else if (elem.tagName() == "umbrella") {
+                    ParserOptions::umbrellaMode = (elem.text() == "true");
+                }
+                else if (pchHeader.filePath().isEmpty() && elem.tagName() == "pch") {
+                    pchHeader = QFileInfo(elem.text());
+                }
+                else if (moduleCache.isEmpty() && elem.tagName() == "moduleCache") {
+                    moduleCache = elem.text();
+                }
                 else if (!hasCommandLineGenerator && elem.tagName() == "generator") {
                     generator = elem.text();
                 }
@@ -170,6 +667,16 @@ int main(int argc, char **argv)
                         dir = dir.nextSibling();
                     }
                 }
+                else if (elem.tagName() == "allowedPaths") {
+                    QDomNode dir = elem.firstChild();
+                    while (!dir.isNull()) {
+                        QDomElement elem = dir.toElement();
+                        if (!elem.isNull() && elem.tagName() == "dir") {
+                            ParserOptions::allowedPaths << elem.text();
+                        }
+                        dir = dir.nextSibling();
+                    }
+                }
                 else if (elem.tagName() == "definesList") {
                     // reference to an external file, so it can be auto-generated
                     ParserOptions::definesList = QFileInfo(elem.text());
@@ -195,28 +702,76 @@ int main(int argc, char **argv)
             qWarning() << "Couldn't find config file" << configFile.filePath();
         }
 
-        // first try to load plugins from the executable's directory
-        QLibrary lib(app.applicationDirPath() + "/generator_" + generator);
-        lib.load();
-        if (!lib.isLoaded()) {
-            lib.unload();
-            lib.setFileName(app.applicationDirPath() + "/../lib" + LIB_SUFFIX + "/smokegen/generator_" + generator);
-            lib.load();
+        if (!emitModelFile.isEmpty() && !modelFile.isEmpty()) {
+            qCritical() << "--emit-model and --model can't be used together";
+            return EXIT_FAILURE;
         }
-        if (!lib.isLoaded()) {
-            lib.unload();
-            lib.setFileName("generator_" + generator);
+        bool resident = !serverName.isEmpty() || watch;
+        if (resident && (!emitModelFile.isEmpty() || !modelFile.isEmpty())) {
+            qCritical() << "--serve and --watch can't be used together with --emit-model or --model";
+            return EXIT_FAILURE;
+        }
+        if (resident && !cacheDir.isEmpty()) {
+            // changes are only noticed in files that were read while parsing
+            qWarning() << "-cache is ignored with --serve and --watch";
+            cacheDir.clear();
+        }
+
+        // no generator is run when only emitting the model
+        GenerateFn generate = 0;
+        QLibrary lib;
+        if (emitModelFile.isEmpty()) {
+            // first try to load plugins from the executable's directory
+            lib.setFileName(app.applicationDirPath() + "/generator_" + generator);
             lib.load();
+            if (!lib.isLoaded()) {
+                lib.unload();
+                lib.setFileName(app.applicationDirPath() + "/../lib" + LIB_SUFFIX + "/smokegen/generator_" + generator);
+                lib.load();
+            }
+            if (!lib.isLoaded()) {
+                lib.unload();
+                lib.setFileName("generator_" + generator);
+                lib.load();
+            }
+            if (!lib.isLoaded()) {
+                qCritical() << lib.errorString();
+                return EXIT_FAILURE;
+            }
+            qDebug() << "using generator" << lib.fileName();
+            generate = (GenerateFn)lib.resolve("generate");
+            if (!generate) {
+                qCritical() << "couldn't resolve symbol 'generate', aborting";
+                return EXIT_FAILURE;
+            }
         }
-        if (!lib.isLoaded()) {
-            qCritical() << lib.errorString();
-            return EXIT_FAILURE;
+
+        ConfigureFn configure = 0;
+        if (ParserOptions::lazyClassRegistration && modelFile.isEmpty()) {
+            // The generator reads its options before parsing and fills in
+            // ParserOptions::classList, the classes it's going to use.
+            configure = (ConfigureFn)lib.resolve("configure");
+            if (!configure) {
+                qWarning() << "the generator can't tell which classes it needs, -lazy is ignored";
+                ParserOptions::lazyClassRegistration = false;
+            }
+            else if (configure() != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
         }
-        qDebug() << "using generator" << lib.fileName();
-        GenerateFn generate = (GenerateFn)lib.resolve("generate");
-        if (!generate) {
-            qCritical() << "couldn't resolve symbol 'generate', aborting";
-            return EXIT_FAILURE;
+
+        if (!modelFile.isEmpty()) {
+            // the headers have been parsed by an earlier "smokegen --emit-model"
+            bool loaded;
+            {
+                PhaseTimer timer("model", "load " + modelFile);
+                loaded = loadModel(modelFile);
+            }
+            if (!loaded) {
+                qCritical() << "couldn't load model from" << modelFile;
+                return EXIT_FAILURE;
+            }
+            return runGenerator(generate, timeTrace);
         }
 
         foreach(QDir dir, ParserOptions::includeDirs) {
@@ -226,6 +781,30 @@ int main(int argc, char **argv)
             }
         }
 
+        // Unless given explicitly, declarations are registered from the include
+        // dirs and the directories of the parsed headers. Anything else, like
+        // the system headers, is only registered when it's referenced.
+        if (ParserOptions::allowedPaths.isEmpty()) {
+            foreach(QDir dir, ParserOptions::includeDirs + ParserOptions::frameworkDirs) {
+                ParserOptions::allowedPaths << dir.absolutePath();
+            }
+            foreach(QFileInfo file, ParserOptions::headerList) {
+                ParserOptions::allowedPaths << file.absolutePath();
+            }
+        }
+        // The parsed files are compared by their real paths, so symlinks
+        // (e.g. to an SDK or a package prefix) have to be resolved here, too.
+        for (int i = 0; i < ParserOptions::allowedPaths.count(); i++) {
+            QString path = QDir::cleanPath(QDir(ParserOptions::allowedPaths[i]).absolutePath());
+            QString canonical = QFileInfo(path).canonicalFilePath();
+            if (!canonical.isEmpty())
+                path = canonical;
+            if (!path.endsWith('/'))
+                path += '/';
+            ParserOptions::allowedPaths[i] = path;
+        }
+        ParserOptions::allowedPaths.removeDuplicates();
+
         QStringList defines;
         if (ParserOptions::definesList.exists()) {
             QFile file(ParserOptions::definesList.filePath());
@@ -242,49 +821,235 @@ int main(int argc, char **argv)
         }
 
         QFile log("generator.log");
-        bool logErrors = log.open(QFile::WriteOnly | QFile::Truncate);
+        log.open(QFile::WriteOnly | QFile::Truncate);
         QTextStream logOut(&log);
 
-        foreach(QFileInfo file, ParserOptions::headerList) {
-            qDebug() << "parsing" << file.absoluteFilePath();
+        foreach(QDir dir, ParserOptions::includeDirs) {
+            Argv.push_back("-I" + dir.path().toStdString());
+        }
+        foreach(QDir dir, ParserOptions::frameworkDirs) {
+            Argv.push_back("-iframework");
+            Argv.push_back(dir.path().toStdString());
+        }
+        foreach(QString define, defines) {
+            Argv.push_back("-D" + define.toStdString());
+        }
+        Argv.push_back("-I/builtins");
 
-            foreach(QDir dir, ParserOptions::includeDirs) {
-                Argv.push_back("-I" + dir.path().toStdString());
-            }
-            foreach(QDir dir, ParserOptions::frameworkDirs) {
-                Argv.push_back("-iframework");
-                Argv.push_back(dir.path().toStdString());
-            }
-            foreach(QString define, defines) {
-                Argv.push_back("-D" + define.toStdString());
+        if (!moduleCache.isEmpty()) {
+            // Headers covered by a module map are compiled into a module once
+            // and then loaded from the cache, across headers and runs. The
+            // modules are built with the same options as the parsed headers,
+            // e.g. without function bodies, so the cache shouldn't be shared
+            // with a compiler. Declarations imported from a module are
+            // registered by SmokegenASTConsumer::HandleTranslationUnit().
+            QDir dir(moduleCache);
+            if (!dir.exists() && !dir.mkpath(".")) {
+                qCritical() << "couldn't create directory" << moduleCache;
+                return EXIT_FAILURE;
             }
-            Argv.push_back(file.absoluteFilePath().toStdString());
-            Argv.push_back("-I/builtins");
-            Argv.push_back("-fsyntax-only");
+            Argv.push_back("-fmodules");
+            Argv.push_back("-fmodules-cache-path=" + dir.absolutePath().toStdString());
+        }
 
-            clang::FileManager FM({ "." });
-            FM.Retain();
+        // The embedded builtins and the umbrella file live in memory, on top
+        // of a cached view of the real file system that all invocations share.
+        llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> memoryFileSystem(new llvm::vfs::InMemoryFileSystem);
+        for (const EmbeddedFile* f = EmbeddedFiles; f->filename; ++f) {
+            memoryFileSystem->addFile(f->filename, 0, llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(f->content, f->size), f->filename));
+        }
+        llvm::IntrusiveRefCntPtr<CachingFileSystem> cachingFileSystem(new CachingFileSystem(llvm::vfs::getRealFileSystem()));
+        llvm::IntrusiveRefCntPtr<llvm::vfs::OverlayFileSystem> fileSystem(new llvm::vfs::OverlayFileSystem(cachingFileSystem));
+        fileSystem->pushOverlay(memoryFileSystem);
 
-            clang::tooling::ToolInvocation inv(Argv, std::make_unique<SmokegenFrontendAction>(), &FM);
+        clang::FileManager fileManager({ "." }, fileSystem);
+        fileManager.Retain();
 
-            const EmbeddedFile* f = EmbeddedFiles;
-            while (f->filename) {
-                inv.mapVirtualFile(f->filename, { f->content, f->size });
-                ++f;
+        std::vector<std::string> pchArgv;
+        if (!pchHeader.filePath().isEmpty()) {
+            // Everything declared in the PCH is only registered when it's
+            // referenced from one of the parsed headers, so it should be made
+            // up of the headers of the parent modules (e.g. QtCore).
+            if (!pchHeader.exists()) {
+                qCritical() << "didn't find file" << pchHeader.filePath();
+                return EXIT_FAILURE;
             }
-
-            if (!inv.run()) {
+            QString pch = precompiledHeader(pchHeader, Argv, &fileManager);
+            if (pch.isEmpty()) {
+                qCritical() << "couldn't build precompiled header for" << pchHeader.filePath();
                 return 1;
             }
+            pchArgv = Argv;
+            Argv.push_back("-include-pch");
+            Argv.push_back(pch.toStdString());
+        }
 
-            // this has already been parsed because it was included by some header
-            if (!logErrors)
-                continue;
+        Argv.push_back("-fsyntax-only");
+
+        QString modelCache;
+        if (!cacheDir.isEmpty()) {
+            QDir dir(cacheDir);
+            if (!dir.exists() && !dir.mkpath(".")) {
+                qCritical() << "couldn't create directory" << cacheDir;
+                return EXIT_FAILURE;
+            }
+            modelCache = modelCacheFile(dir, Argv);
+        }
+
+        bool modelCacheLoaded = !modelCache.isEmpty() && loadCachedModel(modelCache);
+        if (modelCacheLoaded) {
+            qDebug() << "loaded model from" << modelCache;
+        }
+        else if (!parseHeaders(Argv, fileSystem, *memoryFileSystem, &fileManager, jobs, parseAll)) {
+            return 1;
+        }
+
+        if (!modelCache.isEmpty() && !modelCacheLoaded) {
+            saveCachedModel(modelCache, *cachingFileSystem);
         }
 
         log.close();
 
-        return generate();
+        if (!emitModelFile.isEmpty()) {
+            if (!saveModel(emitModelFile)) {
+                qCritical() << "couldn't write model to" << emitModelFile;
+                return EXIT_FAILURE;
+            }
+            printReports(timeTrace);
+            return EXIT_SUCCESS;
+        }
+
+        if (resident) {
+            ResetFn reset = (ResetFn)lib.resolve("reset");
+            if (!reset) {
+                qCritical() << "the generator can't be run more than once, it can't be used with --serve or --watch";
+                return EXIT_FAILURE;
+            }
+
+            // The generator adds to the model (e.g. implicit constructors), so
+            // it's always run on a copy of what has been parsed. The file
+            // system cache is kept, only what changed on disk is read again.
+            QByteArray parsedModel;
+            auto keepParsedModel = [&parsedModel] {
+                parsedModel.clear();
+                QDataStream stream(&parsedModel, QIODevice::WriteOnly);
+                saveModel(stream);
+            };
+            keepParsedModel();
+            bool needsParse = false;
+            QFileSystemWatcher watcher;
+
+            auto regenerate = [&](const QStringList& changedFiles, QStringList* writtenFiles, QString* error) {
+                std::vector<std::string> paths;
+                foreach (const QString& file, changedFiles) {
+                    paths.push_back(QFileInfo(file).absoluteFilePath().toStdString());
+                }
+                if (cachingFileSystem->refresh(paths))
+                    needsParse = true;
+
+                reset();
+                if (configure) {
+                    // the config may have been changed to ask for other classes
+                    QStringList classList = ParserOptions::classList;
+                    ParserOptions::classList.clear();
+                    if (configure() != EXIT_SUCCESS) {
+                        *error = "couldn't configure the generator";
+                        return false;
+                    }
+                    if (ParserOptions::classList != classList)
+                        needsParse = true;
+                }
+
+                clearModel();
+                if (needsParse) {
+                    qDebug() << "parsing again";
+                    SmokegenASTVisitor::reset();
+
+                    // a new file manager, the old one still has the sizes and
+                    // contents of the files before they changed
+                    clang::FileManager files({ "." }, fileSystem);
+                    files.Retain();
+                    if (!pchArgv.empty() && precompiledHeader(pchHeader, pchArgv, &files).isEmpty()) {
+                        *error = "couldn't build precompiled header for " + pchHeader.filePath();
+                        return false;
+                    }
+                    if (!parseHeaders(Argv, fileSystem, *memoryFileSystem, &files, jobs, parseAll)) {
+                        *error = "couldn't parse the headers";
+                        return false;
+                    }
+                    needsParse = false;
+                    keepParsedModel();
+                }
+                else {
+                    QDataStream stream(parsedModel);
+                    if (!loadModel(stream)) {
+                        *error = "couldn't restore the parsed model";
+                        needsParse = true;
+                        return false;
+                    }
+                }
+
+                if (watch)
+                    watchParsedFiles(watcher, *cachingFileSystem);
+
+                OutputFile::clearWrittenFiles();
+                int result = runGenerator(generate, timeTrace);
+                *writtenFiles = OutputFile::writtenFiles();
+                if (result != EXIT_SUCCESS) {
+                    *error = "the generator failed";
+                    return false;
+                }
+                return true;
+            };
+
+            QStringList writtenFiles;
+            QString error;
+            if (!regenerate(QStringList(), &writtenFiles, &error)) {
+                qCritical() << error;
+                return EXIT_FAILURE;
+            }
+
+            SmokegenServer server(regenerate);
+            if (!serverName.isEmpty()) {
+                if (!server.listen(serverName)) {
+                    qCritical() << "couldn't listen on" << serverName << "-" << server.errorString();
+                    return EXIT_FAILURE;
+                }
+                qDebug() << "waiting for requests on" << serverName;
+            }
+
+            // Saving a header usually touches it more than once (or replaces
+            // it), so changes are collected for a moment before regenerating.
+            QStringList changedFiles;
+            QTimer settle;
+            settle.setSingleShot(true);
+            settle.setInterval(200);
+            QObject::connect(&watcher, &QFileSystemWatcher::fileChanged, [&](const QString& path) {
+                if (!changedFiles.contains(path))
+                    changedFiles << path;
+                settle.start();
+            });
+            QObject::connect(&settle, &QTimer::timeout, [&] {
+                QStringList files = changedFiles;
+                changedFiles.clear();
+                qDebug() << "changed:" << files;
+
+                QElapsedTimer timer;
+                timer.start();
+                QStringList writtenFiles;
+                QString error;
+                if (regenerate(files, &writtenFiles, &error))
+                    qDebug() << "regenerated in" << timer.elapsed() << "ms, written:" << writtenFiles;
+                else
+                    qCritical() << error;
+            });
+            if (watch)
+                qDebug() << "watching" << watcher.files().count() << "files for changes";
+
+            return app.exec();
+        }
+
+        return runGenerator(generate, timeTrace);
     }
     catch (const std::exception& e)
     {
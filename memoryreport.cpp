@@ -0,0 +1,201 @@
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QVector>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+#include "memoryreport.h"
+#include "type.h"
+
+bool MemoryReport::enabled = false;
+
+namespace {
+
+struct Entry {
+    QByteArray section;
+    QString name;
+    qint64 entries;
+    qint64 bytes;
+};
+
+QMutex entriesLock;
+QVector<Entry> entries;
+
+// The types in parameters and members point into 'types' and are accounted
+// for there; only what is held by value is counted here. Names, namespaces and
+// file names are interned and show up once under 'symbols'.
+
+qint64 parametersSize(const ParameterList& params)
+{
+    qint64 size = MemoryReport::listSize(params);
+    foreach (const Parameter& param, params) {
+        size += MemoryReport::stringSize(param.defaultValue());
+    }
+    return size;
+}
+
+qint64 typeSize(const Type& type)
+{
+    qint64 size = MemoryReport::listSize(type.templateArguments()) + parametersSize(type.parameters())
+                + MemoryReport::stringSize(type.cachedString()) + type.extraSize();
+    if (type.isArray())
+        size += type.arrayDimensions() * sizeof(int);
+    foreach (const Type& arg, type.templateArguments()) {
+        size += typeSize(arg);
+    }
+    return size;
+}
+
+qint64 declarationSize(const BasicTypeDeclaration& decl)
+{
+    return MemoryReport::stringSize(decl.cachedQualifiedName());
+}
+
+qint64 classSize(const Class& klass)
+{
+    qint64 size = declarationSize(klass) + MemoryReport::listSize(klass.methods()) + MemoryReport::listSize(klass.fields())
+                + MemoryReport::listSize(klass.baseClasses()) + MemoryReport::listSize(klass.children());
+    foreach (const Method& meth, klass.methods()) {
+        size += parametersSize(meth.parameters())
+              + MemoryReport::listSize(meth.exceptionTypes()) + MemoryReport::listSize(meth.remainingDefaultValues());
+        foreach (const QString& value, meth.remainingDefaultValues()) {
+            size += MemoryReport::stringSize(value);
+        }
+    }
+    size += MemoryReport::listSize(klass.properties());
+    foreach (const Property& property, klass.properties()) {
+        size += MemoryReport::stringSize(property.name()) + MemoryReport::stringSize(property.typeName())
+              + MemoryReport::stringSize(property.read()) + MemoryReport::stringSize(property.write())
+              + MemoryReport::stringSize(property.member()) + MemoryReport::stringSize(property.reset())
+              + MemoryReport::stringSize(property.notify());
+    }
+    return size;
+}
+
+qint64 enumSize(const Enum& e)
+{
+    qint64 size = declarationSize(e) + MemoryReport::listSize(e.members());
+    foreach (const EnumMember& member, e.members()) {
+        size += MemoryReport::stringSize(member.value());
+    }
+    return size;
+}
+
+qint64 globalSize(const GlobalVar&)
+{
+    return 0;
+}
+
+qint64 functionSize(const Function& fn)
+{
+    return parametersSize(fn.parameters());
+}
+
+qint64 typedefSize(const Typedef& tdef)
+{
+    return declarationSize(tdef);
+}
+
+template<typename T>
+void addRegistry(const QString& name, const Registry<T>& registry, qint64 (*entitySize)(const T&))
+{
+    qint64 size = registry.storageSize();
+    for (typename Registry<T>::const_iterator it = registry.constBegin(); it != registry.constEnd(); ++it) {
+        size += MemoryReport::stringSize(it.key()) + entitySize(it.value());
+    }
+    MemoryReport::add("model", name, registry.count(), size);
+}
+
+QString megabytes(qint64 bytes)
+{
+    return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MB";
+}
+
+}
+
+void MemoryReport::add(const char* section, const QString& name, qint64 count, qint64 bytes)
+{
+    QMutexLocker locker(&entriesLock);
+    entries << Entry{ section, name, count, bytes };
+}
+
+void MemoryReport::addModel()
+{
+    addRegistry("classes", ::classes, &classSize);
+    addRegistry("typedefs", ::typedefs, &typedefSize);
+    addRegistry("enums", ::enums, &enumSize);
+    addRegistry("functions", ::functions, &functionSize);
+    addRegistry("globals", ::globals, &globalSize);
+    addRegistry("types", ::types, &typeSize);
+    Type::addKeysToMemoryReport();
+
+    QStringList symbols = Symbol::table();
+    // a hash node for each entry, like in hashSize()
+    qint64 size = symbols.count() * (sizeof(void*) + sizeof(uint) + sizeof(QString));
+    foreach (const QString& symbol, symbols) {
+        size += MemoryReport::stringSize(symbol);
+    }
+    MemoryReport::add("model", "symbols", symbols.count(), size);
+}
+
+qint64 MemoryReport::peakResidentSize()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return counters.PeakWorkingSetSize;
+#elif defined(Q_OS_UNIX)
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(Q_OS_MAC)
+    return usage.ru_maxrss;
+#else
+    // in kilobytes everywhere else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return -1;
+#endif
+}
+
+void MemoryReport::print()
+{
+    QMutexLocker locker(&entriesLock);
+
+    QTextStream out(stderr);
+    out << "Memory report (approximate heap usage; shared data is counted for every reference):\n";
+
+    qint64 peak = peakResidentSize();
+    if (peak >= 0)
+        out << "  peak RSS: " << megabytes(peak) << "\n";
+
+    // sections in the order they were first seen
+    QList<QByteArray> sections;
+    foreach (const Entry& entry, entries) {
+        if (!sections.contains(entry.section))
+            sections << entry.section;
+    }
+
+    foreach (const QByteArray& section, sections) {
+        qint64 total = 0;
+        foreach (const Entry& entry, entries) {
+            if (entry.section == section)
+                total += entry.bytes;
+        }
+        out << "  " << section << ": " << megabytes(total) << "\n";
+
+        foreach (const Entry& entry, entries) {
+            if (entry.section != section)
+                continue;
+            out << "      " << entry.name << ": " << entry.entries << " entries, " << megabytes(entry.bytes) << "\n";
+        }
+    }
+}
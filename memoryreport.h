@@ -0,0 +1,56 @@
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include "generator_export.h"
+
+// Collects the number of entries and the approximate heap usage of the big
+// containers of a run, if smokegen is started with --memory-report.
+// Generators add the caches they keep.
+struct GENERATOR_EXPORT MemoryReport
+{
+    static bool enabled;
+
+    // Adds a container called 'name' to 'section' of the report.
+    static void add(const char* section, const QString& name, qint64 entries, qint64 bytes);
+
+    // Adds the registries from type.cpp, including everything the entities in
+    // there own, like methods, fields and parameters.
+    static void addModel();
+
+    // Peak resident set size of the process in bytes, or -1 if unknown.
+    static qint64 peakResidentSize();
+
+    // Prints the peak RSS and all added containers.
+    static void print();
+
+    // Rough heap usage of the containers themselves. The data owned by the
+    // keys and values isn't included. Implicitly shared data is counted for
+    // every reference to it.
+    static qint64 stringSize(const QString& str)
+    {
+        return str.isNull() ? 0 : sizeof(QArrayData) + (str.capacity() + 1) * sizeof(QChar);
+    }
+
+    template<typename K, typename V>
+    static qint64 hashSize(const QHash<K, V>& hash)
+    {
+        // the bucket array, plus a node with 'next', the hash value, the key
+        // and the value for each entry
+        return hash.capacity() * sizeof(void*) + hash.count() * (sizeof(void*) + sizeof(uint) + sizeof(K) + sizeof(V));
+    }
+
+    template<typename T>
+    static qint64 listSize(const QList<T>& list)
+    {
+        // QList keeps an array of pointers and allocates large or static
+        // types separately
+        qint64 node = (QTypeInfo<T>::isLarge || QTypeInfo<T>::isStatic) ? sizeof(T) : 0;
+        return list.isEmpty() ? 0 : list.count() * (sizeof(void*) + node);
+    }
+};
+
+#endif
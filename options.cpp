@@ -32,3 +32,8 @@ bool ParserOptions::resolveTypedefs = false;
 QList<QString> ParserOptions::notToBeResolved;
 bool ParserOptions::qtMode = false;
 QStringList ParserOptions::dropMacros;
+bool ParserOptions::umbrellaMode = false;
+bool ParserOptions::parseFunctionBodies = false;
+QStringList ParserOptions::allowedPaths;
+bool ParserOptions::lazyClassRegistration = false;
+QStringList ParserOptions::classList;
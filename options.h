@@ -42,6 +42,11 @@ struct GENERATOR_EXPORT ParserOptions
     static QList<QString> notToBeResolved;
     static bool qtMode;
     static QStringList dropMacros;
+    static bool umbrellaMode;
+    static bool parseFunctionBodies;
+    static QStringList allowedPaths;
+    static bool lazyClassRegistration;
+    static QStringList classList;
 };
 
 #endif
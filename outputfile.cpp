@@ -0,0 +1,48 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtDebug>
+
+#include "outputfile.h"
+
+static QStringList written;
+
+OutputFile::OutputFile(const QString& fileName)
+    : m_fileName(fileName)
+{
+}
+
+OutputFile::~OutputFile()
+{
+    if (isOpen())
+        qWarning() << "generated file" << m_fileName << "was never committed";
+}
+
+bool OutputFile::commit()
+{
+    close();
+
+    QFile existing(m_fileName);
+    if (existing.open(QIODevice::ReadOnly) && existing.size() == data().size() && existing.readAll() == data())
+        return true;
+    existing.close();
+
+    QSaveFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data()) != data().size() || !file.commit()) {
+        qWarning() << "couldn't write" << m_fileName;
+        return false;
+    }
+
+    written << QFileInfo(m_fileName).absoluteFilePath();
+    return true;
+}
+
+QStringList OutputFile::writtenFiles()
+{
+    return written;
+}
+
+void OutputFile::clearWrittenFiles()
+{
+    written.clear();
+}
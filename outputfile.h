@@ -0,0 +1,33 @@
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+
+#include <QBuffer>
+#include <QStringList>
+
+#include "generator_export.h"
+
+// A generated file. Everything written to it is kept in memory until
+// commit(), which only touches the file on disk if its contents differ, so
+// unchanged outputs don't get rebuilt.
+class GENERATOR_EXPORT OutputFile : public QBuffer
+{
+public:
+    OutputFile(const QString& fileName);
+    ~OutputFile();
+
+    QString fileName() const { return m_fileName; }
+
+    // Closes the buffer and writes it out if needed. Returns false if the
+    // file couldn't be written.
+    bool commit();
+
+    // The files that were actually written since the last call of
+    // clearWrittenFiles(), with absolute paths.
+    static QStringList writtenFiles();
+    static void clearWrittenFiles();
+
+private:
+    QString m_fileName;
+};
+
+#endif
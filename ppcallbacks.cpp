@@ -11,6 +11,12 @@ void SmokegenPPCallbacks::InjectQObjectDefs(clang::SourceLocation Loc) {
 void SmokegenPPCallbacks::FileChanged(clang::SourceLocation Loc, FileChangeReason Reason,
         clang::SrcMgr::CharacteristicKind FileType, clang::FileID PrevFID) {
 
+    if (enteredFiles && Reason == EnterFile) {
+        clang::SourceManager &sm = pp.getSourceManager();
+        if (auto entered = sm.getFileEntryForID(sm.getFileID(Loc)))
+            enteredFiles->insert(entered->getUniqueID());
+    }
+
     auto F = pp.getSourceManager().getFileEntryForID(PrevFID);
     if (!F)
         return;
@@ -21,3 +27,17 @@ void SmokegenPPCallbacks::FileChanged(clang::SourceLocation Loc, FileChangeReaso
         InjectQObjectDefs(Loc);
     }
 }
+
+void SmokegenPPCallbacks::InclusionDirective(clang::SourceLocation HashLoc, const clang::Token &IncludeTok,
+        clang::StringRef FileName, bool IsAngled, clang::CharSourceRange FilenameRange,
+        const clang::FileEntry *File, clang::StringRef SearchPath, clang::StringRef RelativePath,
+        const clang::Module *Imported, clang::SrcMgr::CharacteristicKind FileType) {
+
+    // The module only becomes visible after this callback. The injected
+    // definitions are entered now, but lexed after the import, and they check
+    // for themselves whether qobjectdefs.h was part of it. Once its macros
+    // are visible, the injection has been done by an earlier import.
+    if (Imported && !pp.isMacroDefined("Q_MOC_OUTPUT_REVISION")) {
+        InjectQObjectDefs(FilenameRange.getEnd());
+    }
+}
@@ -2,18 +2,34 @@
 #define SMOKEGEN_PPCALLBACKS
 
 #include <clang/Lex/Preprocessor.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Support/FileSystem/UniqueID.h>
+
+// Identifies files independently of the FileManager they were opened with.
+typedef llvm::DenseSet<llvm::sys::fs::UniqueID> UniqueFileSet;
 
 class SmokegenPPCallbacks : public clang::PPCallbacks {
 public:
-    SmokegenPPCallbacks(clang::Preprocessor &pp) : pp(pp) {}
+    // Every file entered while preprocessing is added to 'enteredFiles', if
+    // it's given.
+    SmokegenPPCallbacks(clang::Preprocessor &pp, UniqueFileSet *enteredFiles = nullptr)
+        : pp(pp), enteredFiles(enteredFiles) {}
 
     void FileChanged(clang::SourceLocation Loc, FileChangeReason Reason,
             clang::SrcMgr::CharacteristicKind FileType, clang::FileID PrevFID) override;
 
+    // With -fmodules, qobjectdefs.h may never be entered. Its macros become
+    // visible through a module import instead.
+    void InclusionDirective(clang::SourceLocation HashLoc, const clang::Token &IncludeTok,
+            clang::StringRef FileName, bool IsAngled, clang::CharSourceRange FilenameRange,
+            const clang::FileEntry *File, clang::StringRef SearchPath, clang::StringRef RelativePath,
+            const clang::Module *Imported, clang::SrcMgr::CharacteristicKind FileType) override;
+
 private:
     void InjectQObjectDefs(clang::SourceLocation Loc);
 
     clang::Preprocessor &pp;
+    UniqueFileSet *enteredFiles;
 };
 
 #endif
@@ -0,0 +1,191 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// Holds the entities of the model by their qualified names. The entities are
+// kept in fixed-size chunks that are never moved or shared, so pointers to
+// them stay valid until they're erased or the registry is cleared, no matter
+// what is added in the meantime. The hash only maps names to slots.
+// Iterating visits the entities in the order of their slots, which is the
+// order they were added unless some were erased.
+template<typename T>
+class Registry
+{
+    struct Slot
+    {
+        Slot() : used(false) {}
+
+        QString key;
+        T value;
+        bool used;
+    };
+
+    enum { ChunkSize = 256 };
+
+public:
+    template<typename R, typename V>
+    class Iterator
+    {
+    public:
+        Iterator() : m_registry(0), m_slot(0) {}
+        Iterator(R* registry, int slot) : m_registry(registry), m_slot(slot) { skipUnused(); }
+
+        // iterator to const_iterator
+        template<typename R2, typename V2>
+        Iterator(const Iterator<R2, V2>& other) : m_registry(other.m_registry), m_slot(other.m_slot) {}
+
+        const QString& key() const { return m_registry->slot(m_slot).key; }
+        V& value() const { return m_registry->slot(m_slot).value; }
+        V& operator*() const { return value(); }
+        V* operator->() const { return &value(); }
+
+        Iterator& operator++() { ++m_slot; skipUnused(); return *this; }
+        Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+
+        bool operator==(const Iterator& other) const { return m_slot == other.m_slot; }
+        bool operator!=(const Iterator& other) const { return m_slot != other.m_slot; }
+
+    private:
+        template<typename, typename> friend class Iterator;
+        friend class Registry;
+
+        void skipUnused()
+        {
+            while (m_slot < m_registry->m_size && !m_registry->slot(m_slot).used)
+                ++m_slot;
+        }
+
+        R* m_registry;
+        int m_slot;
+    };
+
+    typedef Iterator<Registry, T> iterator;
+    typedef Iterator<const Registry, const T> const_iterator;
+
+    Registry() : m_size(0) {}
+    ~Registry() { clear(); }
+
+    int count() const { return m_index.count(); }
+    int size() const { return m_index.count(); }
+    bool isEmpty() const { return m_index.isEmpty(); }
+    bool contains(const QString& key) const { return m_index.contains(key); }
+
+    // Returns the entity called 'key', adding a default-constructed one if
+    // there is none yet.
+    T& operator[](const QString& key)
+    {
+        int i = m_index.value(key, -1);
+        if (i == -1)
+            i = allocate(key);
+        return slot(i).value;
+    }
+
+    T value(const QString& key, const T& defaultValue = T()) const
+    {
+        int i = m_index.value(key, -1);
+        return i == -1 ? defaultValue : slot(i).value;
+    }
+
+    // Replaces the entity called 'key', if there is one. Pointers to it stay
+    // valid.
+    iterator insert(const QString& key, const T& value)
+    {
+        int i = m_index.value(key, -1);
+        if (i == -1)
+            i = allocate(key);
+        slot(i).value = value;
+        return iterator(this, i);
+    }
+
+    iterator find(const QString& key) { return iterator(this, m_index.value(key, m_size)); }
+    const_iterator find(const QString& key) const { return constFind(key); }
+    const_iterator constFind(const QString& key) const { return const_iterator(this, m_index.value(key, m_size)); }
+
+    // The slot of the erased entity is reused by the next one that is added.
+    iterator erase(iterator it)
+    {
+        Slot& s = slot(it.m_slot);
+        m_index.remove(s.key);
+        s.key = QString();
+        s.value = T();
+        s.used = false;
+        m_free << it.m_slot;
+        return ++it;
+    }
+
+    void clear()
+    {
+        foreach (Slot* chunk, m_chunks)
+            delete[] chunk;
+        m_chunks.clear();
+        m_free.clear();
+        m_index.clear();
+        m_size = 0;
+    }
+
+    QList<QString> keys() const
+    {
+        QList<QString> list;
+        list.reserve(count());
+        for (const_iterator it = constBegin(); it != constEnd(); ++it)
+            list << it.key();
+        return list;
+    }
+
+    QList<T> values() const
+    {
+        QList<T> list;
+        list.reserve(count());
+        for (const_iterator it = constBegin(); it != constEnd(); ++it)
+            list << it.value();
+        return list;
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_size); }
+    const_iterator begin() const { return constBegin(); }
+    const_iterator end() const { return constEnd(); }
+    const_iterator constBegin() const { return const_iterator(this, 0); }
+    const_iterator constEnd() const { return const_iterator(this, m_size); }
+
+    // Approximate heap usage of the chunks and the name index, without the
+    // data owned by the entities.
+    qint64 storageSize() const
+    {
+        return qint64(m_chunks.count()) * ChunkSize * sizeof(Slot) + m_index.capacity() * sizeof(void*)
+             + m_index.count() * (sizeof(void*) + sizeof(uint) + sizeof(QString) + sizeof(int));
+    }
+
+private:
+    Q_DISABLE_COPY(Registry)
+
+    Slot& slot(int i) const { return m_chunks[i / ChunkSize][i % ChunkSize]; }
+
+    int allocate(const QString& key)
+    {
+        int i;
+        if (!m_free.isEmpty()) {
+            i = m_free.takeLast();
+        } else {
+            if (m_size % ChunkSize == 0)
+                m_chunks << new Slot[ChunkSize];
+            i = m_size++;
+        }
+        Slot& s = slot(i);
+        s.key = key;
+        s.used = true;
+        m_index.insert(key, i);
+        return i;
+    }
+
+    QVector<Slot*> m_chunks;
+    QVector<int> m_free;
+    QHash<QString, int> m_index;
+    int m_size;
+};
+
+#endif
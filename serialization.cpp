@@ -0,0 +1,641 @@
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QVector>
+
+#include "serialization.h"
+#include "options.h"
+#include "type.h"
+
+// Layout of a model:
+//   quint32     ModelMagic
+//   quint32     ModelFormatVersion
+//   QStringList string table, all strings of the model are indices into it
+//   QByteArray  the model itself, as written by ModelWriter
+// Pointers between classes, enums, typedefs and types are stored as indices
+// into the respective registry, -1 being a null pointer.
+
+static const quint32 ModelMagic = 0x534d4b4d; // "SMKM"
+static const quint32 ModelFormatVersion = 2;
+
+namespace {
+
+enum DeclKind {
+    Decl_None,
+    Decl_Class,
+    Decl_Enum,
+    Decl_Typedef
+};
+
+template<typename T>
+void indexRegistry(const Registry<T>& registry, QHash<const T*, qint32>& index)
+{
+    qint32 i = 0;
+    for (typename Registry<T>::const_iterator it = registry.constBegin(); it != registry.constEnd(); ++it) {
+        index[&it.value()] = i++;
+    }
+}
+
+class ModelWriter
+{
+public:
+    ModelWriter(QDataStream& stream) : s(stream)
+    {
+        indexRegistry(classes, classIndex);
+        indexRegistry(enums, enumIndex);
+        indexRegistry(typedefs, typedefIndex);
+        indexRegistry(types, typeIndex);
+
+        for (QHash<const Class*, qint32>::const_iterator it = classIndex.constBegin(); it != classIndex.constEnd(); ++it)
+            declIndex[it.key()] = qMakePair(quint8(Decl_Class), it.value());
+        for (QHash<const Enum*, qint32>::const_iterator it = enumIndex.constBegin(); it != enumIndex.constEnd(); ++it)
+            declIndex[it.key()] = qMakePair(quint8(Decl_Enum), it.value());
+        for (QHash<const Typedef*, qint32>::const_iterator it = typedefIndex.constBegin(); it != typedefIndex.constEnd(); ++it)
+            declIndex[it.key()] = qMakePair(quint8(Decl_Typedef), it.value());
+    }
+
+    void write()
+    {
+        QStringList headers;
+        foreach (const QFileInfo& file, ParserOptions::headerList)
+            headers << file.absoluteFilePath();
+        writeStrings(headers);
+
+        // The keys come first, so the reader can create all entries before
+        // resolving references to them.
+        writeKeys(classes);
+        writeKeys(enums);
+        writeKeys(typedefs);
+        writeKeys(types);
+        writeKeys(functions);
+        writeKeys(globals);
+
+        // the registries can't be copied, so no foreach here
+        for (const Class& klass : classes)
+            writeClass(klass);
+        for (const Enum& e : enums)
+            writeEnum(e);
+        for (const Typedef& tdef : typedefs) {
+            writeDeclaration(tdef);
+            writeRef(tdef.type());
+        }
+        for (const Type& type : types)
+            writeType(type);
+        for (const Function& fn : functions) {
+            writeGlobalVar(fn);
+            writeParameters(fn.parameters());
+        }
+        for (const GlobalVar& var : globals)
+            writeGlobalVar(var);
+    }
+
+    const QStringList& strings() const { return stringTable; }
+
+private:
+    void writeString(const QString& str)
+    {
+        QHash<QString, qint32>::const_iterator it = stringIndex.constFind(str);
+        if (it == stringIndex.constEnd()) {
+            it = stringIndex.insert(str, stringTable.count());
+            stringTable << str;
+        }
+        s << it.value();
+    }
+
+    void writeStrings(const QStringList& list)
+    {
+        s << qint32(list.count());
+        foreach (const QString& str, list)
+            writeString(str);
+    }
+
+    template<typename T>
+    void writeKeys(const Registry<T>& registry)
+    {
+        s << qint32(registry.count());
+        for (typename Registry<T>::const_iterator it = registry.constBegin(); it != registry.constEnd(); ++it)
+            writeString(it.key());
+    }
+
+    void writeRef(const Class* klass) { s << (klass ? classIndex.value(klass, -1) : -1); }
+    void writeRef(const Enum* e) { s << (e ? enumIndex.value(e, -1) : -1); }
+    void writeRef(const Typedef* tdef) { s << (tdef ? typedefIndex.value(tdef, -1) : -1); }
+    void writeRef(const Type* type) { s << (type ? typeIndex.value(type, -1) : -1); }
+
+    void writeDeclRef(const BasicTypeDeclaration* decl)
+    {
+        QHash<const BasicTypeDeclaration*, QPair<quint8, qint32> >::const_iterator it = declIndex.constFind(decl);
+        if (it != declIndex.constEnd())
+            s << it.value().first << it.value().second;
+        else
+            s << quint8(Decl_None);
+    }
+
+    void writeDeclaration(const BasicTypeDeclaration& decl)
+    {
+        writeString(decl.name());
+        writeString(decl.nameSpace());
+        writeRef(decl.parent());
+        s << quint8(decl.access());
+        writeString(decl.fileName());
+    }
+
+    void writeMember(const Member& member)
+    {
+        writeDeclRef(member.declaringType());
+        writeString(member.name());
+        writeRef(member.type());
+        s << quint8(member.access()) << qint32(member.flags());
+    }
+
+    void writeParameters(const ParameterList& params)
+    {
+        s << qint32(params.count());
+        foreach (const Parameter& param, params) {
+            writeString(param.name());
+            writeRef(param.type());
+            writeString(param.defaultValue());
+        }
+    }
+
+    void writeClass(const Class& klass)
+    {
+        writeDeclaration(klass);
+        s << quint8(klass.kind()) << klass.isForwardDecl() << klass.isNameSpace() << klass.isTemplate();
+
+        s << qint32(klass.methods().count());
+        foreach (const Method& method, klass.methods()) {
+            writeMember(method);
+            writeParameters(method.parameters());
+            s << method.isConstructor() << method.isDestructor() << method.isConst() << method.isQPropertyAccessor()
+              << method.isSignal() << method.isSlot() << method.isDeleted() << method.hasExceptionSpec();
+            s << qint32(method.exceptionTypes().count());
+            foreach (const Type& type, method.exceptionTypes())
+                writeType(type);
+            writeStrings(method.remainingDefaultValues());
+        }
+
+        s << qint32(klass.fields().count());
+        foreach (const Field& field, klass.fields())
+            writeMember(field);
+
+        s << qint32(klass.properties().count());
+        foreach (const Property& property, klass.properties()) {
+            writeString(property.name());
+            writeString(property.typeName());
+            writeRef(property.type());
+            writeString(property.read());
+            writeString(property.write());
+            writeString(property.member());
+            writeString(property.reset());
+            writeString(property.notify());
+            s << qint32(property.revision()) << qint32(property.flags());
+        }
+
+        s << qint32(klass.baseClasses().count());
+        foreach (const Class::BaseClassSpecifier& base, klass.baseClasses()) {
+            writeRef(base.baseClass);
+            s << quint8(base.access) << base.isVirtual;
+        }
+
+        s << qint32(klass.children().count());
+        foreach (const BasicTypeDeclaration* child, klass.children())
+            writeDeclRef(child);
+    }
+
+    void writeEnum(const Enum& e)
+    {
+        writeDeclaration(e);
+        s << qint32(e.members().count());
+        foreach (const EnumMember& member, e.members()) {
+            writeMember(member);
+            writeString(member.value());
+        }
+    }
+
+    void writeType(const Type& type)
+    {
+        writeRef(type.getClass());
+        writeRef(type.getTypedef());
+        writeRef(type.getEnum());
+
+        // name() returns the name of the class, typedef or enum if there is
+        // one, get at the stored name through a copy without them.
+        Type unresolved(type);
+        unresolved.setClass(0);
+        writeString(unresolved.name());
+
+        s << type.isConst() << type.isVolatile() << qint32(type.pointerDepth());
+        for (int i = 0; i < type.pointerDepth(); i++)
+            s << type.isConstPointer(i);
+        s << type.isRef() << type.isIntegral();
+
+        s << qint32(type.arrayDimensions());
+        for (int i = 0; i < type.arrayDimensions(); i++)
+            s << qint32(type.arrayLength(i));
+
+        s << qint32(type.templateArguments().count());
+        foreach (const Type& arg, type.templateArguments())
+            writeType(arg);
+
+        s << type.isFunctionPointer();
+        writeParameters(type.parameters());
+    }
+
+    void writeGlobalVar(const GlobalVar& var)
+    {
+        writeString(var.name());
+        writeString(var.nameSpace());
+        writeRef(var.type());
+        writeString(var.fileName());
+    }
+
+    QDataStream& s;
+    QHash<const Class*, qint32> classIndex;
+    QHash<const Enum*, qint32> enumIndex;
+    QHash<const Typedef*, qint32> typedefIndex;
+    QHash<const Type*, qint32> typeIndex;
+    QHash<const BasicTypeDeclaration*, QPair<quint8, qint32> > declIndex;
+    QHash<QString, qint32> stringIndex;
+    QStringList stringTable;
+};
+
+class ModelReader
+{
+public:
+    ModelReader(QDataStream& stream, const QStringList& strings) : s(stream), stringTable(strings), ok(true) {}
+
+    bool read()
+    {
+        QStringList headers = readStrings();
+        // headers given on the command line take precedence
+        if (ok && ParserOptions::headerList.isEmpty()) {
+            foreach (const QString& header, headers)
+                ParserOptions::headerList << QFileInfo(header);
+        }
+
+        createEntries(classes, classPtrs);
+        createEntries(enums, enumPtrs);
+        createEntries(typedefs, typedefPtrs);
+        createEntries(types, typePtrs);
+        QStringList functionKeys = readStrings();
+        QStringList globalKeys = readStrings();
+
+        for (int i = 0; ok && i < classPtrs.count(); i++)
+            readClass(*classPtrs[i]);
+        for (int i = 0; ok && i < enumPtrs.count(); i++)
+            readEnum(*enumPtrs[i]);
+        for (int i = 0; ok && i < typedefPtrs.count(); i++) {
+            readDeclaration(*typedefPtrs[i]);
+            typedefPtrs[i]->setType(readRef(typePtrs));
+        }
+        for (int i = 0; ok && i < typePtrs.count(); i++)
+            *typePtrs[i] = readType();
+        for (int i = 0; ok && i < functionKeys.count(); i++) {
+            Function fn;
+            readGlobalVar(fn);
+            foreach (const Parameter& param, readParameters())
+                fn.appendParameter(param);
+            functions[functionKeys[i]] = fn;
+        }
+        for (int i = 0; ok && i < globalKeys.count(); i++) {
+            GlobalVar var;
+            readGlobalVar(var);
+            globals[globalKeys[i]] = var;
+        }
+
+        return ok && s.status() == QDataStream::Ok;
+    }
+
+private:
+    qint32 readCount()
+    {
+        qint32 count;
+        s >> count;
+        if (count < 0 || s.status() != QDataStream::Ok) {
+            ok = false;
+            return 0;
+        }
+        return count;
+    }
+
+    QString readString()
+    {
+        qint32 i;
+        s >> i;
+        if (i < 0 || i >= stringTable.count()) {
+            ok = false;
+            return QString();
+        }
+        return stringTable[i];
+    }
+
+    QStringList readStrings()
+    {
+        QStringList list;
+        qint32 count = readCount();
+        for (qint32 i = 0; ok && i < count; i++)
+            list << readString();
+        return list;
+    }
+
+    template<typename T>
+    void createEntries(Registry<T>& registry, QVector<T*>& ptrs)
+    {
+        foreach (const QString& key, readStrings())
+            ptrs << &registry[key];
+    }
+
+    template<typename T>
+    T* readRef(const QVector<T*>& ptrs)
+    {
+        qint32 i;
+        s >> i;
+        if (i == -1)
+            return 0;
+        if (i < 0 || i >= ptrs.count()) {
+            ok = false;
+            return 0;
+        }
+        return ptrs[i];
+    }
+
+    BasicTypeDeclaration* readDeclRef()
+    {
+        quint8 kind;
+        s >> kind;
+        switch (kind) {
+            case Decl_None:
+                return 0;
+            case Decl_Class:
+                return readRef(classPtrs);
+            case Decl_Enum:
+                return readRef(enumPtrs);
+            case Decl_Typedef:
+                return readRef(typedefPtrs);
+        }
+        ok = false;
+        return 0;
+    }
+
+    bool readBool()
+    {
+        bool value;
+        s >> value;
+        return value;
+    }
+
+    void readDeclaration(BasicTypeDeclaration& decl)
+    {
+        quint8 access;
+        decl.setName(readString());
+        decl.setNameSpace(readString());
+        decl.setParent(readRef(classPtrs));
+        s >> access;
+        decl.setAccess(Access(access));
+        decl.setFileName(readString());
+    }
+
+    // The declaring type is read by the caller, as it has to be passed to the
+    // constructor of EnumMember.
+    void readMember(Member& member)
+    {
+        quint8 access;
+        qint32 flags;
+        member.setName(readString());
+        member.setType(readRef(typePtrs));
+        s >> access >> flags;
+        member.setAccess(Access(access));
+        for (int flag = Member::Virtual; flag <= Member::Explicit; flag <<= 1) {
+            if (flags & flag)
+                member.setFlag(Member::Flag(flag));
+        }
+    }
+
+    ParameterList readParameters()
+    {
+        ParameterList params;
+        qint32 count = readCount();
+        for (qint32 i = 0; ok && i < count; i++) {
+            QString name = readString();
+            Type* type = readRef(typePtrs);
+            params << Parameter(name, type, readString());
+        }
+        return params;
+    }
+
+    void readClass(Class& klass)
+    {
+        readDeclaration(klass);
+        quint8 kind;
+        s >> kind;
+        klass.setKind(Class::Kind(kind));
+        klass.setIsForwardDecl(readBool());
+        klass.setIsNameSpace(readBool());
+        klass.setIsTemplate(readBool());
+
+        qint32 count = readCount();
+        for (qint32 i = 0; ok && i < count; i++) {
+            Method method(static_cast<Class*>(readDeclRef()));
+            readMember(method);
+            method.setParameterList(readParameters());
+            method.setIsConstructor(readBool());
+            method.setIsDestructor(readBool());
+            method.setIsConst(readBool());
+            method.setIsQPropertyAccessor(readBool());
+            method.setIsSignal(readBool());
+            method.setIsSlot(readBool());
+            method.setIsDeleted(readBool());
+            method.setHasExceptionSpec(readBool());
+            qint32 exceptionCount = readCount();
+            for (qint32 j = 0; ok && j < exceptionCount; j++)
+                method.appendExceptionType(readType());
+            method.setRemainingDefaultValues(readStrings());
+            klass.appendMethod(method);
+        }
+
+        count = readCount();
+        for (qint32 i = 0; ok && i < count; i++) {
+            Field field(static_cast<Class*>(readDeclRef()));
+            readMember(field);
+            klass.appendField(field);
+        }
+
+        count = readCount();
+        for (qint32 i = 0; ok && i < count; i++) {
+            Property property;
+            qint32 revision, flags;
+            property.setName(readString());
+            property.setTypeName(readString());
+            property.setType(readRef(typePtrs));
+            property.setRead(readString());
+            property.setWrite(readString());
+            property.setMember(readString());
+            property.setReset(readString());
+            property.setNotify(readString());
+            s >> revision >> flags;
+            property.setRevision(revision);
+            for (int flag = Property::Constant; flag <= Property::NotStored; flag <<= 1) {
+                if (flags & flag)
+                    property.setFlag(Property::Flag(flag));
+            }
+            klass.appendProperty(property);
+        }
+
+        count = readCount();
+        for (qint32 i = 0; ok && i < count; i++) {
+            Class::BaseClassSpecifier base;
+            quint8 access;
+            base.baseClass = readRef(classPtrs);
+            s >> access;
+            base.access = Access(access);
+            base.isVirtual = readBool();
+            klass.appendBaseClass(base);
+        }
+
+        count = readCount();
+        for (qint32 i = 0; ok && i < count; i++)
+            klass.appendChild(readDeclRef());
+    }
+
+    void readEnum(Enum& e)
+    {
+        readDeclaration(e);
+        qint32 count = readCount();
+        for (qint32 i = 0; ok && i < count; i++) {
+            EnumMember member(static_cast<Enum*>(readDeclRef()));
+            readMember(member);
+            member.setValue(readString());
+            e.appendMember(member);
+        }
+    }
+
+    Type readType()
+    {
+        Type type;
+        Class* klass = readRef(classPtrs);
+        Typedef* tdef = readRef(typedefPtrs);
+        Enum* e = readRef(enumPtrs);
+        if (klass)
+            type.setClass(klass);
+        else if (tdef)
+            type.setTypedef(tdef);
+        else if (e)
+            type.setEnum(e);
+
+        type.setName(readString());
+
+        type.setIsConst(readBool());
+        type.setIsVolatile(readBool());
+        qint32 pointerDepth = readCount();
+        type.setPointerDepth(pointerDepth);
+        for (qint32 i = 0; ok && i < pointerDepth; i++) {
+            if (readBool())
+                type.setIsConstPointer(i, true);
+        }
+        type.setIsRef(readBool());
+        type.setIsIntegral(readBool());
+
+        qint32 dimensions = readCount();
+        type.setArrayDimensions(dimensions);
+        for (qint32 i = 0; ok && i < dimensions; i++) {
+            qint32 length;
+            s >> length;
+            type.setArrayLength(i, length);
+        }
+
+        qint32 count = readCount();
+        for (qint32 i = 0; ok && i < count; i++)
+            type.appendTemplateArgument(readType());
+
+        type.setIsFunctionPointer(readBool());
+        foreach (const Parameter& param, readParameters())
+            type.appendParameter(param);
+
+        return type;
+    }
+
+    void readGlobalVar(GlobalVar& var)
+    {
+        var.setName(readString());
+        var.setNameSpace(readString());
+        var.setType(readRef(typePtrs));
+        var.setFileName(readString());
+    }
+
+    QDataStream& s;
+    const QStringList& stringTable;
+    bool ok;
+    QVector<Class*> classPtrs;
+    QVector<Enum*> enumPtrs;
+    QVector<Typedef*> typedefPtrs;
+    QVector<Type*> typePtrs;
+};
+
+}
+
+void saveModel(QDataStream& stream)
+{
+    QByteArray data;
+    QDataStream s(&data, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_5_0);
+    ModelWriter writer(s);
+    writer.write();
+
+    stream << ModelMagic << ModelFormatVersion << writer.strings() << data;
+}
+
+bool loadModel(QDataStream& stream)
+{
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != ModelMagic) {
+        qWarning() << "not a smokegen model";
+        return false;
+    }
+    if (version != ModelFormatVersion) {
+        qWarning() << "unsupported model format version" << version << "- expected" << ModelFormatVersion;
+        return false;
+    }
+
+    QStringList strings;
+    QByteArray data;
+    stream >> strings >> data;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+
+    QDataStream s(data);
+    s.setVersion(QDataStream::Qt_5_0);
+    if (ModelReader(s, strings).read()) {
+        // the reader creates the types directly, not through registerType()
+        Type::reindex();
+        return true;
+    }
+
+    clearModel();
+    return false;
+}
+
+bool saveModel(const QString& fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    saveModel(stream);
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool loadModel(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    return loadModel(stream);
+}
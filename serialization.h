@@ -0,0 +1,25 @@
+#ifndef SERIALIZATION_H
+#define SERIALIZATION_H
+
+#include "generator_export.h"
+
+class QDataStream;
+class QString;
+
+// Writes all registered classes, enums, typedefs, types, functions and global
+// variables, along with the list of parsed headers, to 'stream'. The format
+// is versioned and pointers between the entities are stored as indices.
+GENERATOR_EXPORT void saveModel(QDataStream& stream);
+
+// Reads a model written by saveModel() into the registries, which have to be
+// empty. ParserOptions::headerList is set from the model if it is empty.
+// Returns false if the data is corrupt or of another format version; the
+// registries are cleared again in that case.
+GENERATOR_EXPORT bool loadModel(QDataStream& stream);
+
+// Convenience versions of the above, operating on the file 'fileName'. This is
+// what "smokegen --emit-model" writes and "smokegen --model" reads.
+GENERATOR_EXPORT bool saveModel(const QString& fileName);
+GENERATOR_EXPORT bool loadModel(const QString& fileName);
+
+#endif
@@ -0,0 +1,61 @@
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QtDebug>
+
+#include "server.h"
+
+bool SmokegenServer::listen(const QString& name)
+{
+    QLocalServer::removeServer(name);
+    if (!server.listen(name))
+        return false;
+
+    QObject::connect(&server, &QLocalServer::newConnection, &server, [this] {
+        while (QLocalSocket* socket = server.nextPendingConnection()) {
+            QObject::connect(socket, &QLocalSocket::readyRead, socket, [this, socket] {
+                while (socket->canReadLine()) {
+                    handleRequest(socket, socket->readLine());
+                }
+            });
+            QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    });
+    return true;
+}
+
+void SmokegenServer::handleRequest(QLocalSocket* socket, const QByteArray& line)
+{
+    QJsonObject reply;
+
+    QJsonParseError parseError;
+    QJsonDocument request = QJsonDocument::fromJson(line, &parseError);
+    if (!request.isObject()) {
+        reply["status"] = QString("error");
+        reply["message"] = "invalid request: " + parseError.errorString();
+    } else if (request.object().value("quit").toBool()) {
+        reply["status"] = QString("ok");
+        QCoreApplication::quit();
+    } else {
+        QStringList changedFiles;
+        foreach (const QJsonValue& file, request.object().value("changed").toArray()) {
+            changedFiles << file.toString();
+        }
+
+        qDebug() << "regenerating, changed files:" << changedFiles;
+        QStringList writtenFiles;
+        QString error;
+        if (handler(changedFiles, &writtenFiles, &error)) {
+            reply["status"] = QString("ok");
+            reply["written"] = QJsonArray::fromStringList(writtenFiles);
+        } else {
+            reply["status"] = QString("error");
+            reply["message"] = error;
+        }
+    }
+
+    socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+    socket->flush();
+}
@@ -0,0 +1,38 @@
+#ifndef SMOKEGEN_SERVER
+#define SMOKEGEN_SERVER
+
+#include <functional>
+
+#include <QLocalServer>
+#include <QStringList>
+
+class QLocalSocket;
+
+// Answers regeneration requests on a local socket, for "smokegen --serve".
+// Requests and replies are single lines of JSON:
+//   -> {"changed": ["/path/to/header.h", ...]}
+//   <- {"status": "ok", "written": ["/path/to/x_1.cpp", ...]}
+//   <- {"status": "error", "message": "..."}
+// "changed" is a hint, files that were read while parsing are checked for
+// changes in any case. {"quit": true} stops the server.
+class SmokegenServer
+{
+public:
+    // Regenerates the output. 'writtenFiles' are the files which actually
+    // changed.
+    typedef std::function<bool(const QStringList& changedFiles, QStringList* writtenFiles, QString* error)> Handler;
+
+    SmokegenServer(const Handler& handler) : handler(handler) {}
+
+    // Listens on 'name', a path on Unix, replacing a stale socket.
+    bool listen(const QString& name);
+    QString errorString() const { return server.errorString(); }
+
+private:
+    void handleRequest(QLocalSocket* socket, const QByteArray& line);
+
+    Handler handler;
+    QLocalServer server;
+};
+
+#endif
@@ -180,6 +180,30 @@ public:
 	Index method;		// Index into methods
     };
 
+    enum PropertyFlags {
+        pf_constant = 0x01,
+        pf_final = 0x02,
+        pf_required = 0x04,
+        pf_user = 0x08,
+        pf_designable = 0x10,
+        pf_scriptable = 0x20,
+        pf_stored = 0x40
+    };
+    /**
+     * Describe one Q_PROPERTY of one class, so bindings don't have to look
+     * it up in the QMetaObject by name.
+     */
+    struct Property {
+	Index classId;		// Index into classes
+	const char *name;	// Name of the property
+	Index type;		// Index into types, 0 if unknown
+	Index read;		// Index into methods for the getter, 0 for none
+	Index write;		// Index into methods for the setter, 0 for none
+	Index reset;		// Index into methods for the reset method, 0 for none
+	Index notify;		// Index into methods for the notify signal, 0 for none
+	unsigned short flags;	// PropertyFlags
+    };
+
     enum TypeFlags {
         // The first 4 bits indicate the TypeId value, i.e. which field
         // of the StackItem union is used.
@@ -290,6 +314,12 @@ public:
      */
     CastFn castFn;
 
+    /**
+     * The properties of the classes in this module, sorted by class and name.
+     */
+    Property *properties;
+    Index numProperties;
+
     /**
      * Constructor
      */
@@ -302,7 +332,8 @@ public:
 	  Index *_inheritanceList,
 	  Index *_argumentList,
 	  Index *_ambiguousMethodList,
-	  CastFn _castFn) :
+	  CastFn _castFn,
+	  Property *_properties = 0, Index _numProperties = 0) :
 		module_name(_moduleName),
 		classes(_classes), numClasses(_numClasses),
 		methods(_methods), numMethods(_numMethods),
@@ -312,7 +343,8 @@ public:
 		inheritanceList(_inheritanceList),
 		argumentList(_argumentList),
 		ambiguousMethodList(_ambiguousMethodList),
-		castFn(_castFn)
+		castFn(_castFn),
+		properties(_properties), numProperties(_numProperties)
         {
             for (Index i = 1; i <= numClasses; ++i) {
                 if (!classes[i].external) {
@@ -513,6 +545,51 @@ public:
         return idc.smoke->findMethod(idc, idname);
     }
 
+    inline ModuleIndex idProperty(Index c, const char *name) {
+        Index imax = numProperties - 1;
+        Index imin = 1;
+        Index icur = -1;
+        int icmp = -1;
+
+        while (imax >= imin) {
+            icur = (imin + imax) / 2;
+            icmp = leg(properties[icur].classId, c);
+            if (icmp == 0) {
+                icmp = strcmp(properties[icur].name, name);
+                if (icmp == 0) {
+                    return ModuleIndex(this, icur);
+                }
+            }
+
+            if (icmp > 0) {
+                imax = icur - 1;
+            } else {
+                imin = icur + 1;
+            }
+        }
+
+        return NullModuleIndex;
+    }
+
+    /**
+     * Looks up the property 'name' of class 'c' or one of its super classes.
+     */
+    inline ModuleIndex findProperty(const char *c, const char *name) {
+        ModuleIndex idc = idClass(c);
+        if (!idc.smoke) idc = findClass(c);
+        if (!idc.smoke || !idc.index) return NullModuleIndex;
+        if (idc.smoke != this) return idc.smoke->findProperty(c, name);
+
+        ModuleIndex pi = idProperty(idc.index, name);
+        if (pi.index) return pi;
+
+        for (Index *i = inheritanceList + classes[idc.index].parents; *i; ++i) {
+            ModuleIndex mi = findProperty(className(*i), name);
+            if (mi.index) return mi;
+        }
+        return NullModuleIndex;
+    }
+
     static inline bool isDerivedFrom(const ModuleIndex& classId, const ModuleIndex& baseClassId) {
         return isDerivedFrom(classId.smoke, classId.index, baseClassId.smoke, baseClassId.index);
     }
@@ -0,0 +1,52 @@
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+
+#include "symbol.h"
+
+namespace {
+
+// Symbols are created during static initialization (e.g. Type::Void), so the
+// table is set up on first use. The nodes of a QHash stay where they are when
+// it grows, which keeps the pointers to the keys valid. It must never be
+// shared though, detaching would copy the nodes.
+QMutex* tableLock()
+{
+    static QMutex lock;
+    return &lock;
+}
+
+QSet<QString>& symbols()
+{
+    static QSet<QString> table;
+    return table;
+}
+
+const QString* emptyString()
+{
+    static const QString empty;
+    return &empty;
+}
+
+}
+
+const QString* Symbol::intern(const QString& string)
+{
+    // null and empty strings compare equal, so they're the same symbol
+    if (string.isEmpty())
+        return emptyString();
+
+    QMutexLocker locker(tableLock());
+    return &*symbols().insert(string);
+}
+
+QStringList Symbol::table()
+{
+    QMutexLocker locker(tableLock());
+    const QSet<QString>& table = symbols();
+    QStringList list;
+    list.reserve(table.size());
+    for (QSet<QString>::const_iterator it = table.constBegin(); it != table.constEnd(); ++it)
+        list << *it;
+    return list;
+}
@@ -0,0 +1,43 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include "generator_export.h"
+
+// A string from a process-wide table. Equal strings are only stored once, so
+// the model keeps a single copy of every name, namespace and file name, no
+// matter how many declarations share it. Symbols are compared by pointer, and
+// the strings handed out by toString() share their data, which QString's
+// comparison operators notice as well. Entries are never removed.
+class GENERATOR_EXPORT Symbol
+{
+public:
+    Symbol() : m_string(intern(QString())) {}
+    Symbol(const QString& string) : m_string(intern(string)) {}
+
+    bool isEmpty() const { return m_string->isEmpty(); }
+
+    const QString& toString() const { return *m_string; }
+    operator const QString&() const { return *m_string; }
+
+    bool operator==(const Symbol& other) const { return m_string == other.m_string; }
+    bool operator!=(const Symbol& other) const { return m_string != other.m_string; }
+
+    // All strings in the table, e.g. for the memory report.
+    static QStringList table();
+
+private:
+    static const QString* intern(const QString& string);
+
+    const QString* m_string;
+};
+
+inline uint qHash(const Symbol& symbol, uint seed = 0)
+{
+    return qHash(static_cast<const void*>(&symbol.toString()), seed);
+}
+
+#endif
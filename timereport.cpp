@@ -0,0 +1,187 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#include <algorithm>
+#include <ctime>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+#include "timereport.h"
+
+bool TimeReport::enabled = false;
+
+namespace {
+
+struct Phase {
+    const char* category;
+    QString name;
+    int thread;
+    qint64 start;
+    qint64 wall;
+    qint64 cpu;
+};
+
+QMutex phasesLock;
+QVector<Phase> phases;
+QHash<Qt::HANDLE, int> threadNumbers;
+
+// Microseconds since the first phase was started.
+qint64 elapsed()
+{
+    static QElapsedTimer timer = [] { QElapsedTimer t; t.start(); return t; }();
+    return timer.nsecsElapsed() / 1000;
+}
+
+// CPU time used by the calling thread in microseconds. Parsing runs on
+// several threads with -j, so the time of the whole process would be useless.
+qint64 threadCpuTime()
+{
+#if defined(Q_OS_WIN)
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+        return 0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) / 10;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+    return qint64(std::clock()) * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+QString milliseconds(qint64 us)
+{
+    return QString::number(us / 1000.0, 'f', 1);
+}
+
+}
+
+void TimeReport::addPhase(const char* category, const QString& name, qint64 start, qint64 wall, qint64 cpu)
+{
+    QMutexLocker locker(&phasesLock);
+    Qt::HANDLE thread = QThread::currentThreadId();
+    if (!threadNumbers.contains(thread))
+        threadNumbers.insert(thread, threadNumbers.count());
+    phases << Phase{ category, name, threadNumbers[thread], start, wall, cpu };
+}
+
+void TimeReport::print()
+{
+    QMutexLocker locker(&phasesLock);
+
+    // categories in the order they were first seen
+    QList<QByteArray> categories;
+    QHash<QByteArray, QVector<const Phase*> > byCategory;
+    for (int i = 0; i < phases.count(); i++) {
+        const Phase& phase = phases.at(i);
+        if (!byCategory.contains(phase.category))
+            categories << phase.category;
+        byCategory[phase.category] << &phase;
+    }
+
+    QTextStream out(stderr);
+    out << "Time report (wall / cpu in ms; nested phases are included in their parents):\n";
+    foreach (const QByteArray& category, categories) {
+        QVector<const Phase*>& list = byCategory[category];
+        qint64 wall = 0, cpu = 0;
+        foreach (const Phase* phase, list) {
+            wall += phase->wall;
+            cpu += phase->cpu;
+        }
+        out << "  " << category << ": " << milliseconds(wall) << " / " << milliseconds(cpu)
+            << " in " << list.count() << (list.count() == 1 ? " phase\n" : " phases\n");
+
+        if (list.count() == 1)
+            continue;
+
+        std::sort(list.begin(), list.end(), [](const Phase* a, const Phase* b) { return a->wall > b->wall; });
+        for (int i = 0; i < list.count() && i < 5; i++) {
+            out << "      " << milliseconds(list[i]->wall) << " / " << milliseconds(list[i]->cpu)
+                << "  " << list[i]->name << "\n";
+        }
+    }
+}
+
+bool TimeReport::writeTrace(const QString& fileName)
+{
+    QMutexLocker locker(&phasesLock);
+
+    QJsonArray events;
+    qint64 pid = QCoreApplication::applicationPid();
+    foreach (const Phase& phase, phases) {
+        QJsonObject args;
+        args["cpu_us"] = phase.cpu;
+
+        QJsonObject event;
+        event["name"] = phase.name;
+        event["cat"] = QString::fromLatin1(phase.category);
+        event["ph"] = QString("X");
+        event["ts"] = phase.start;
+        event["dur"] = phase.wall;
+        event["pid"] = pid;
+        event["tid"] = phase.thread;
+        event["args"] = args;
+        events << event;
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = QString("ms");
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) != -1;
+}
+
+PhaseTimer::PhaseTimer(const char* category, const QString& name)
+    : m_category(category), m_name(name), m_start(0), m_cpuStart(0)
+{
+    start();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    finish();
+}
+
+void PhaseTimer::restart(const QString& name)
+{
+    finish();
+    m_name = name;
+    start();
+}
+
+void PhaseTimer::start()
+{
+    if (!TimeReport::enabled)
+        return;
+    m_start = elapsed();
+    m_cpuStart = threadCpuTime();
+}
+
+void PhaseTimer::finish()
+{
+    if (!TimeReport::enabled)
+        return;
+    TimeReport::addPhase(m_category, m_name, m_start, elapsed() - m_start, threadCpuTime() - m_cpuStart);
+}
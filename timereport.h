@@ -0,0 +1,50 @@
+#ifndef TIMEREPORT_H
+#define TIMEREPORT_H
+
+#include <QString>
+
+#include "generator_export.h"
+
+// Collects the wall and CPU time spent in the phases of a run, if smokegen is
+// started with --time-report. Generators can add phases of their own with
+// PhaseTimer.
+struct GENERATOR_EXPORT TimeReport
+{
+    static bool enabled;
+
+    // Adds a finished phase. All times are in microseconds, 'start' being
+    // relative to the start of the run. Can be called from any thread.
+    static void addPhase(const char* category, const QString& name, qint64 start, qint64 wall, qint64 cpu);
+
+    // Prints the total time spent in each category, along with its slowest
+    // phases.
+    static void print();
+
+    // Writes all phases to 'fileName' in the Trace Event Format understood by
+    // chrome://tracing.
+    static bool writeTrace(const QString& fileName);
+};
+
+// Measures the time from its construction to its destruction as a phase of
+// the time report. Does nothing unless TimeReport::enabled is set.
+class GENERATOR_EXPORT PhaseTimer
+{
+public:
+    PhaseTimer(const char* category, const QString& name);
+    ~PhaseTimer();
+
+    // Ends the current phase and starts the next one, 'name', in the same
+    // category.
+    void restart(const QString& name);
+
+private:
+    void start();
+    void finish();
+
+    const char* m_category;
+    QString m_name;
+    qint64 m_start;
+    qint64 m_cpuStart;
+};
+
+#endif
@@ -17,18 +17,49 @@
 */
 
 #include "type.h"
+#include "memoryreport.h"
 #include "options.h"
 #include <iostream>
 
-QHash<QString, Class> classes;
-QHash<QString, Typedef> typedefs;
-QHash<QString, Enum> enums;
-QHash<QString, Function> functions;
-QHash<QString, GlobalVar> globals;
-QHash<QString, Type> types;
+Registry<Class> classes;
+Registry<Typedef> typedefs;
+Registry<Enum> enums;
+Registry<Function> functions;
+Registry<GlobalVar> globals;
+Registry<Type> types;
+
+// The entries of 'types' by their components, see Type::registerType().
+static QHash<QVector<quintptr>, Type*> typesByKey;
+
+void clearModel()
+{
+    classes.clear();
+    enums.clear();
+    typedefs.clear();
+    functions.clear();
+    globals.clear();
+    // Type::Void points into the registry, so that entry has to stay
+    for (Registry<Type>::iterator it = types.begin(); it != types.end();) {
+        if (&it.value() == Type::Void)
+            ++it;
+        else
+            it = types.erase(it);
+    }
+    for (QHash<QVector<quintptr>, Type*>::iterator it = typesByKey.begin(); it != typesByKey.end();) {
+        if (it.value() == Type::Void)
+            ++it;
+        else
+            it = typesByKey.erase(it);
+    }
+}
+
+uint BasicTypeDeclaration::namesRevision = 1;
 
 QString BasicTypeDeclaration::toString() const
 {
+    if (m_qualifiedNameRevision == namesRevision)
+        return m_qualifiedName;
+
     QString ret;
     Class* parent = m_parent;
     while (parent) {
@@ -36,8 +67,11 @@ QString BasicTypeDeclaration::toString() const
         parent = parent->parent();
     }
     if (!m_nspace.isEmpty())
-        ret.prepend(m_nspace + "::");
+        ret.prepend(m_nspace.toString() + "::");
     ret += m_name;
+
+    m_qualifiedName = ret;
+    m_qualifiedNameRevision = namesRevision;
     return ret;
 }
 
@@ -92,18 +126,186 @@ QString Method::toString(bool withAccess, bool withClass, bool withInitializer)
     return ret;
 }
 
+struct Type::Extra
+{
+    QList<Type> templateArgs;
+    ParameterList params;
+    QVector<int> arrayLengths;
+};
+
+Type::Type(const Type& other)
+    : m_class(other.m_class), m_typedef(other.m_typedef), m_enum(other.m_enum), m_name(other.m_name),
+      m_isConst(other.m_isConst), m_isVolatile(other.m_isVolatile), m_isRef(other.m_isRef),
+      m_isIntegral(other.m_isIntegral), m_isFunctionPointer(other.m_isFunctionPointer),
+      m_pointerDepth(other.m_pointerDepth), m_constPointer(other.m_constPointer),
+      m_stringRevision(other.m_stringRevision), m_extra(other.m_extra ? new Extra(*other.m_extra) : 0),
+      m_string(other.m_string)
+{
+}
+
+Type::~Type()
+{
+    delete m_extra;
+}
+
+Type& Type::operator=(const Type& other)
+{
+    if (this == &other)
+        return *this;
+    m_class = other.m_class;
+    m_typedef = other.m_typedef;
+    m_enum = other.m_enum;
+    m_name = other.m_name;
+    m_isConst = other.m_isConst;
+    m_isVolatile = other.m_isVolatile;
+    m_isRef = other.m_isRef;
+    m_isIntegral = other.m_isIntegral;
+    m_isFunctionPointer = other.m_isFunctionPointer;
+    m_pointerDepth = other.m_pointerDepth;
+    m_constPointer = other.m_constPointer;
+    m_stringRevision = other.m_stringRevision;
+    delete m_extra;
+    m_extra = other.m_extra ? new Extra(*other.m_extra) : 0;
+    m_string = other.m_string;
+    return *this;
+}
+
+Type::Extra* Type::extra()
+{
+    if (!m_extra)
+        m_extra = new Extra;
+    return m_extra;
+}
+
+void Type::setArrayDimensions(int dim)
+{
+    if (dim || m_extra)
+        extra()->arrayLengths.resize(dim);
+    invalidateString();
+}
+
+int Type::arrayDimensions() const
+{
+    return m_extra ? m_extra->arrayLengths.size() : 0;
+}
+
+void Type::setArrayLength(int dim, int length)
+{
+    extra()->arrayLengths[dim] = length;
+    invalidateString();
+}
+
+int Type::arrayLength(int dim) const
+{
+    return m_extra->arrayLengths[dim];
+}
+
+const QList<Type>& Type::templateArguments() const
+{
+    static const QList<Type> none;
+    return m_extra ? m_extra->templateArgs : none;
+}
+
+void Type::appendTemplateArgument(const Type& type)
+{
+    extra()->templateArgs.append(type);
+    invalidateString();
+}
+
+void Type::setTemplateArguments(const QList<Type>& types)
+{
+    if (!types.isEmpty() || m_extra)
+        extra()->templateArgs = types;
+    invalidateString();
+}
+
+const ParameterList& Type::parameters() const
+{
+    static const ParameterList none;
+    return m_extra ? m_extra->params : none;
+}
+
+void Type::appendParameter(const Parameter& param)
+{
+    extra()->params.append(param);
+    invalidateString();
+}
+
 const Type* Type::Void = Type::registerType(Type("void"));
 
-#ifdef Q_OS_WIN
 Type* Type::registerType(const Type& type)
 {
-    QString typeString = type.toString();
-    QHash<QString, Type>::iterator iter = types.insert(typeString, type);
-    return &iter.value();
+    QVector<quintptr> key;
+    type.appendKey(key);
+    Type*& entry = typesByKey[key];
+    if (!entry) {
+        // Types that are built differently can still have the same string,
+        // so 'types' stays the authority and this only caches its entries.
+        QString typeString = type.toString();
+        Registry<Type>::iterator iter = types.insert(typeString, type);
+        entry = &iter.value();
+    } else {
+        // like types.insert(), the last registration wins
+        *entry = type;
+    }
+    return entry;
+}
+
+void Type::reindex()
+{
+    typesByKey.clear();
+    for (Registry<Type>::iterator it = types.begin(); it != types.end(); ++it) {
+        QVector<quintptr> key;
+        it->appendKey(key);
+        typesByKey.insert(key, &it.value());
+    }
+}
+
+void Type::addKeysToMemoryReport()
+{
+    qint64 size = MemoryReport::hashSize(typesByKey);
+    for (QHash<QVector<quintptr>, Type*>::const_iterator it = typesByKey.constBegin(); it != typesByKey.constEnd(); ++it) {
+        size += sizeof(QArrayData) + it.key().capacity() * sizeof(quintptr);
+    }
+    MemoryReport::add("model", "type keys", typesByKey.count(), size);
+}
+
+qint64 Type::extraSize() const
+{
+    return m_extra ? sizeof(Extra) : 0;
+}
+
+void Type::appendKey(QVector<quintptr>& key) const
+{
+    // Names are interned, so their address identifies them. The counts in
+    // front of the lists keep nested types from running into each other.
+    key << quintptr(m_class) << quintptr(m_typedef) << quintptr(m_enum) << quintptr(&m_name.toString());
+    key << (m_isConst | m_isVolatile << 1 | m_isRef << 2 | m_isIntegral << 3 | m_isFunctionPointer << 4);
+
+    key << m_pointerDepth << m_constPointer;
+
+    if (!m_extra) {
+        key << 0 << 0 << 0;
+        return;
+    }
+
+    key << m_extra->arrayLengths.size();
+    foreach (int length, m_extra->arrayLengths)
+        key << length;
+
+    key << m_extra->templateArgs.size();
+    foreach (const Type& arg, m_extra->templateArgs)
+        arg.appendKey(key);
+
+    key << m_extra->params.size();
+    foreach (const Parameter& param, m_extra->params)
+        key << quintptr(param.type());
 }
-#endif
 
 Type Typedef::resolve() const {
+    if (m_resolved)
+        return *m_resolved;
+
     bool isRef = false, isConst = false, isVolatile = false;
     QList<bool> pointerDepth;
 
@@ -138,6 +340,7 @@ Type Typedef::resolve() const {
     for (int i = 0; i < pointerDepth.count(); i++) {
         ret.setIsConstPointer(i, pointerDepth[i]);
     }
+    m_resolved.reset(new Type(ret));
     return ret;
 }
 
@@ -145,7 +348,7 @@ QString GlobalVar::toString(bool prepend = true) const
 {
     QString ret = m_type->toString(QString(), prepend) + " ";
     if (!m_nspace.isEmpty())
-        ret += m_nspace + "::";
+        ret += m_nspace.toString() + "::";
     ret += m_name;
     return ret;
 }
@@ -163,16 +366,29 @@ QString Function::toString(bool prepend = true) const
 }
 
 QString Type::toString(const QString& fnPtrName, bool prepend) const
+{
+    if (!fnPtrName.isEmpty() || !prepend)
+        return format(fnPtrName, prepend);
+
+    if (m_stringRevision != BasicTypeDeclaration::namesRevision) {
+        m_string = format(QString(), true);
+        m_stringRevision = BasicTypeDeclaration::namesRevision;
+    }
+    return m_string;
+}
+
+QString Type::format(const QString& fnPtrName, bool prepend) const
 {
     QString ret;
     if (m_isVolatile) ret += "volatile ";
     if (m_isConst) ret += "const ";
     ret += name(prepend);
-    if (!m_templateArgs.isEmpty()) {
+    const QList<Type>& templateArgs = templateArguments();
+    if (!templateArgs.isEmpty()) {
         ret += "<";
-        for (int i = 0; i < m_templateArgs.count(); i++) {
+        for (int i = 0; i < templateArgs.count(); i++) {
             if (i > 0) ret += ',';
-            ret += m_templateArgs[i].toString(QString(), prepend);
+            ret += templateArgs[i].toString(QString(), prepend);
         }
         ret += ">";
     }
@@ -190,15 +406,16 @@ QString Type::toString(const QString& fnPtrName, bool prepend) const
     if (isArray()) ret += fnPtrName;
     if (isArray() && (m_pointerDepth > 0 || m_isRef)) ret += ')';
     
-    foreach(int size, m_arrayLengths) {
-        ret += '[' + QString::number(size) + ']';
+    for (int i = 0; i < arrayDimensions(); i++) {
+        ret += '[' + QString::number(arrayLength(i)) + ']';
     }
     
     if (m_isFunctionPointer) {
+        const ParameterList& params = parameters();
         ret += "(*" + fnPtrName + ")(";
-        for (int i = 0; i < m_params.count(); i++) {
+        for (int i = 0; i < params.count(); i++) {
             if (i > 0) ret += ',';
-            ret += m_params[i].type()->toString(QString(), prepend);
+            ret += params[i].type()->toString(QString(), prepend);
         }
         ret += ')';
     }
@@ -22,9 +22,12 @@
 #include <QString>
 #include <QStringList>
 #include <QHash>
+#include <QSharedPointer>
 #include <QtDebug>
 
 #include "generator_export.h"
+#include "registry.h"
+#include "symbol.h"
 
 class Class;
 class Typedef;
@@ -33,15 +36,19 @@ class GlobalVar;
 class Function;
 class Type;
 
-extern GENERATOR_EXPORT QHash<QString, Class> classes;
-extern GENERATOR_EXPORT QHash<QString, Typedef> typedefs;
-extern GENERATOR_EXPORT QHash<QString, Enum> enums;
-extern GENERATOR_EXPORT QHash<QString, Function> functions;
-extern GENERATOR_EXPORT QHash<QString, GlobalVar> globals;
-extern GENERATOR_EXPORT QHash<QString, Type> types;
+extern GENERATOR_EXPORT Registry<Class> classes;
+extern GENERATOR_EXPORT Registry<Typedef> typedefs;
+extern GENERATOR_EXPORT Registry<Enum> enums;
+extern GENERATOR_EXPORT Registry<Function> functions;
+extern GENERATOR_EXPORT Registry<GlobalVar> globals;
+extern GENERATOR_EXPORT Registry<Type> types;
+
+// Empties all of the above, except for Type::Void.
+GENERATOR_EXPORT void clearModel();
 
 class Method;
 class Field;
+class Property;
 
 enum Access {
     Access_public,
@@ -54,17 +61,17 @@ class Class;
 class GENERATOR_EXPORT BasicTypeDeclaration
 {
 public:
-    BasicTypeDeclaration() : m_access(Access_public) {}
+    BasicTypeDeclaration() : m_access(Access_public), m_qualifiedNameRevision(0) {}
     virtual ~BasicTypeDeclaration() {}
     virtual bool isValid() const { return !m_name.isEmpty(); }
     
-    void setName(const QString& name) { m_name = name; }
+    void setName(const QString& name) { m_name = name; ++namesRevision; }
     QString name() const { return m_name; }
     
-    void setNameSpace(const QString& nspace) { m_nspace = nspace; }
+    void setNameSpace(const QString& nspace) { m_nspace = nspace; ++namesRevision; }
     QString nameSpace() const { return m_nspace; }
 
-    void setParent(Class* parent) { m_parent = parent; }
+    void setParent(Class* parent) { m_parent = parent; ++namesRevision; }
     Class* parent() const { return m_parent; }
 
     void setAccess(Access access) { m_access = access; }
@@ -73,17 +80,28 @@ public:
     void setFileName(const QString& fileName) { m_file = fileName; }
     QString fileName() const { return m_file; }
 
+    // The qualified name. It's kept until the name, namespace or parent of
+    // any declaration changes, as that may affect the names nested in it.
     QString toString() const;
+    // The string toString() keeps, possibly outdated or empty, e.g. for the
+    // memory report.
+    const QString& cachedQualifiedName() const { return m_qualifiedName; }
+
+    // Incremented whenever a name, namespace or parent is set. Cached
+    // strings built from qualified names are valid for one revision.
+    static uint namesRevision;
 
 protected:
     BasicTypeDeclaration(const QString& name, const QString& nspace = QString(), Class* parent = 0)
-        : m_name(name), m_nspace(nspace), m_parent(parent) {}
+        : m_name(name), m_nspace(nspace), m_parent(parent), m_qualifiedNameRevision(0) {}
 
-    QString m_name;
-    QString m_nspace;
+    Symbol m_name;
+    Symbol m_nspace;
     Class* m_parent;
-    QString m_file;
+    Symbol m_file;
     Access m_access;
+    mutable QString m_qualifiedName;
+    mutable uint m_qualifiedNameRevision;
 };
 
 class GENERATOR_EXPORT Class : public BasicTypeDeclaration
@@ -122,6 +140,9 @@ public:
     QList<Field>& fieldsRef() { return m_fields; }
     void appendField(const Field& field) {  m_fields.append(field); }
     
+    const QList<Property>& properties() const { return m_properties; }
+    void appendProperty(const Property& property) { m_properties.append(property); }
+    
     const QList<BaseClassSpecifier>& baseClasses() const { return m_bases; }
     void appendBaseClass(const BaseClassSpecifier& baseClass) { m_bases.append(baseClass); }
     
@@ -138,6 +159,7 @@ private:
     bool m_isTemplate;
     QList<Method> m_methods;
     QList<Field> m_fields;
+    QList<Property> m_properties;
     QList<BaseClassSpecifier> m_bases;
     QList<BasicTypeDeclaration*> m_children;
 };
@@ -151,13 +173,17 @@ public:
 
     virtual bool isValid() const { return (!m_name.isEmpty() && m_type); }
 
-    void setType(Type* type) { m_type = type; }
+    void setType(Type* type) { m_type = type; m_resolved.clear(); }
     Type* type() const { return m_type; }
 
+    // Follows the chain of typedefs down to the aliased type. The result is
+    // computed once and shared by the copies of this typedef, until the
+    // type is set again.
     Type resolve() const;
 
 private:
     Type* m_type;
+    mutable QSharedPointer<Type> m_resolved;
 };
 
 class EnumMember;
@@ -223,7 +249,7 @@ public:
 
 protected:
     BasicTypeDeclaration* m_typeDecl;
-    QString m_name;
+    Symbol m_name;
     Type* m_type;
     Access m_access;
     Flags m_flags;
@@ -271,7 +297,7 @@ public:
     QString toString() const;
 
 protected:
-    QString m_name;
+    Symbol m_name;
     Type* m_type;
     QString m_defaultValue;
 };
@@ -350,6 +376,74 @@ public:
     Class* getClass() const { return static_cast<Class*>(m_typeDecl); }
 };
 
+// A Q_PROPERTY declaration. The accessors are kept by name, as they're written
+// in the declaration. The type is the one of the READ method, or of the MEMBER
+// field if there's no READ method.
+class GENERATOR_EXPORT Property
+{
+public:
+    enum Flag {
+        Constant = 0x1,
+        Final = 0x2,
+        Required = 0x4,
+        User = 0x8,
+        NotDesignable = 0x10,
+        NotScriptable = 0x20,
+        NotStored = 0x40,
+    };
+    Q_DECLARE_FLAGS(Flags, Flag)
+
+    Property(const QString& name = QString(), const QString& typeName = QString(), Type* type = 0)
+        : m_name(name), m_typeName(typeName), m_type(type), m_revision(0) {}
+
+    bool isValid() const { return !m_name.isEmpty(); }
+
+    void setName(const QString& name) { m_name = name; }
+    QString name() const { return m_name; }
+
+    // the type as written in the declaration
+    void setTypeName(const QString& typeName) { m_typeName = typeName; }
+    QString typeName() const { return m_typeName; }
+
+    void setType(Type* type) { m_type = type; }
+    Type* type() const { return m_type; }
+
+    void setRead(const QString& read) { m_read = read; }
+    QString read() const { return m_read; }
+
+    void setWrite(const QString& write) { m_write = write; }
+    QString write() const { return m_write; }
+
+    void setMember(const QString& member) { m_member = member; }
+    QString member() const { return m_member; }
+
+    void setReset(const QString& reset) { m_reset = reset; }
+    QString reset() const { return m_reset; }
+
+    void setNotify(const QString& notify) { m_notify = notify; }
+    QString notify() const { return m_notify; }
+
+    void setRevision(int revision) { m_revision = revision; }
+    int revision() const { return m_revision; }
+
+    void setFlag(Flag flag) { m_flags |= flag; }
+    Flags flags() const { return m_flags; }
+
+private:
+    QString m_name;
+    QString m_typeName;
+    Type* m_type;
+    QString m_read;
+    QString m_write;
+    QString m_member;
+    QString m_reset;
+    QString m_notify;
+    int m_revision;
+    Flags m_flags;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(Property::Flags)
+
 class GENERATOR_EXPORT GlobalVar
 {
 public:
@@ -380,10 +474,10 @@ public:
     virtual QString toString(bool prepend) const;
 
 protected:
-    QString m_name;
-    QString m_nspace;
+    Symbol m_name;
+    Symbol m_nspace;
     Type* m_type;
-    QString m_file;
+    Symbol m_file;
 };
 
 class GENERATOR_EXPORT Function : public GlobalVar
@@ -405,28 +499,32 @@ class GENERATOR_EXPORT Type
 {
 public:
     Type(Class* klass = 0, bool isConst = false, bool isVolatile = false, int pointerDepth = 0, bool isRef = false)
-        : m_class(klass), m_typedef(0), m_enum(0), m_isConst(isConst), m_isVolatile(isVolatile), 
-          m_pointerDepth(pointerDepth), m_isRef(isRef), m_isIntegral(false), m_isFunctionPointer(false) {}
+        : m_class(klass), m_typedef(0), m_enum(0), m_isConst(isConst), m_isVolatile(isVolatile), m_isRef(isRef),
+          m_isIntegral(false), m_isFunctionPointer(false), m_pointerDepth(pointerDepth), m_constPointer(0), m_stringRevision(0), m_extra(0) {}
     Type(Typedef* tdef, bool isConst = false, bool isVolatile = false, int pointerDepth = 0, bool isRef = false)
-        : m_class(0), m_typedef(tdef), m_enum(0), m_isConst(isConst), m_isVolatile(isVolatile), 
-          m_pointerDepth(pointerDepth), m_isRef(isRef), m_isIntegral(false), m_isFunctionPointer(false) {}
+        : m_class(0), m_typedef(tdef), m_enum(0), m_isConst(isConst), m_isVolatile(isVolatile), m_isRef(isRef),
+          m_isIntegral(false), m_isFunctionPointer(false), m_pointerDepth(pointerDepth), m_constPointer(0), m_stringRevision(0), m_extra(0) {}
     Type(Enum* e, bool isConst = false, bool isVolatile = false, int pointerDepth = 0, bool isRef = false)
-        : m_class(0), m_typedef(0), m_enum(e), m_isConst(isConst), m_isVolatile(isVolatile), 
-          m_pointerDepth(pointerDepth), m_isRef(isRef), m_isIntegral(false), m_isFunctionPointer(false) {}
+        : m_class(0), m_typedef(0), m_enum(e), m_isConst(isConst), m_isVolatile(isVolatile), m_isRef(isRef),
+          m_isIntegral(false), m_isFunctionPointer(false), m_pointerDepth(pointerDepth), m_constPointer(0), m_stringRevision(0), m_extra(0) {}
     Type(const QString& name, bool isConst = false, bool isVolatile = false, int pointerDepth = 0, bool isRef = false)
-        : m_class(0), m_typedef(0), m_enum(0), m_name(name), m_isConst(isConst), m_isVolatile(isVolatile), 
-          m_pointerDepth(pointerDepth), m_isRef(isRef), m_isIntegral(false), m_isFunctionPointer(false) {}
+        : m_class(0), m_typedef(0), m_enum(0), m_name(name), m_isConst(isConst), m_isVolatile(isVolatile), m_isRef(isRef),
+          m_isIntegral(false), m_isFunctionPointer(false), m_pointerDepth(pointerDepth), m_constPointer(0), m_stringRevision(0), m_extra(0) {}
+    Type(const Type& other);
+    ~Type();
+
+    Type& operator=(const Type& other);
 
-    void setClass(Class* klass) { m_class = klass; m_typedef = 0; m_enum = 0; }
+    void setClass(Class* klass) { m_class = klass; m_typedef = 0; m_enum = 0; invalidateString(); }
     Class* getClass() const { return m_class; }
     
-    void setTypedef(Typedef* tdef) { m_typedef = tdef; m_class = 0; m_enum = 0; }
+    void setTypedef(Typedef* tdef) { m_typedef = tdef; m_class = 0; m_enum = 0; invalidateString(); }
     Typedef* getTypedef() const { return m_typedef; }
 
-    void setEnum(Enum* e) { m_enum = e; m_class = 0; m_typedef = 0; }
+    void setEnum(Enum* e) { m_enum = e; m_class = 0; m_typedef = 0; invalidateString(); }
     Enum* getEnum() const { return m_enum; }
 
-    void setName(const QString& name) { m_name = name; }
+    void setName(const QString& name) { m_name = name; invalidateString(); }
     QString name(bool prepend = true) const {
         if (m_class) {
             return (prepend ? "::": "") + m_class->toString();
@@ -441,71 +539,109 @@ public:
 
     bool isValid() const { return (m_class || m_typedef || !m_name.isEmpty()); }
     
-    void setIsConst(bool isConst) { m_isConst = isConst; }
+    void setIsConst(bool isConst) { m_isConst = isConst; invalidateString(); }
     bool isConst() const { return m_isConst; }
-    void setIsVolatile(bool isVolatile) { m_isVolatile = isVolatile; }
+    void setIsVolatile(bool isVolatile) { m_isVolatile = isVolatile; invalidateString(); }
     bool isVolatile() const { return m_isVolatile; }
     
-    void setPointerDepth(int depth) { m_pointerDepth = depth; }
+    void setPointerDepth(int depth) { m_pointerDepth = depth; invalidateString(); }
     int pointerDepth() const { return m_pointerDepth; }
     
-    void setIsConstPointer(int depth, bool isConst) { m_constPointer[depth] = isConst; }
-    bool isConstPointer(int depth) const { return m_constPointer.value(depth, false); }
+    // Only the first MaxConstPointers depths can be const.
+    void setIsConstPointer(int depth, bool isConst) {
+        Q_ASSERT(!isConst || depth < MaxConstPointers);
+        if (depth >= MaxConstPointers)
+            return;
+        if (isConst)
+            m_constPointer |= 1u << depth;
+        else
+            m_constPointer &= ~(1u << depth);
+        invalidateString();
+    }
+    bool isConstPointer(int depth) const { return depth < MaxConstPointers && (m_constPointer & (1u << depth)); }
     
-    void setIsRef(bool isRef) { m_isRef = isRef; }
+    void setIsRef(bool isRef) { m_isRef = isRef; invalidateString(); }
     bool isRef() const { return m_isRef; }
 
     void setIsIntegral(bool isIntegral) { m_isIntegral = isIntegral; }
     bool isIntegral() const { return m_isIntegral; }
 
-    void setArrayDimensions(int dim) { m_arrayLengths.resize(dim); }
-    int arrayDimensions() const { return m_arrayLengths.size(); }
-    bool isArray() const { return m_arrayLengths.size(); }
+    void setArrayDimensions(int dim);
+    int arrayDimensions() const;
+    bool isArray() const { return arrayDimensions(); }
 
-    void setArrayLength(int dim, int length) { m_arrayLengths[dim] = length; }
-    int arrayLength(int dim) const { return m_arrayLengths[dim]; }
+    void setArrayLength(int dim, int length);
+    int arrayLength(int dim) const;
 
-    const QList<Type>& templateArguments() const { return m_templateArgs; }
-    void appendTemplateArgument(const Type& type) { m_templateArgs.append(type); }
-    void setTemplateArguments(const QList<Type>& types) { m_templateArgs = types; }
+    const QList<Type>& templateArguments() const;
+    void appendTemplateArgument(const Type& type);
+    void setTemplateArguments(const QList<Type>& types);
 
-    void setIsFunctionPointer(bool isPtr) { m_isFunctionPointer = isPtr; }
+    void setIsFunctionPointer(bool isPtr) { m_isFunctionPointer = isPtr; invalidateString(); }
     bool isFunctionPointer() const { return m_isFunctionPointer; }
-    const ParameterList& parameters() const { return m_params; }
-    void appendParameter(const Parameter& param) { m_params.append(param); }
+    const ParameterList& parameters() const;
+    void appendParameter(const Parameter& param);
 
+    // The plain form, without a function pointer name and with leading "::"
+    // for classes, is cached like the qualified names of declarations.
     QString toString(const QString& fnPtrName = QString(), bool prepend = true) const;
+    // The string toString() keeps, possibly outdated or empty.
+    const QString& cachedString() const { return m_string; }
 
     bool isAssignable();
 
-    // on windows, we can't reference 'types' here, because it's marked __declspec(dllexport) above.
-    static Type* registerType(const Type& type)
-#ifndef Q_OS_WIN
-    {
-        QString typeString = type.toString();
-        QHash<QString, Type>::iterator iter = types.insert(typeString, type);
-        return &iter.value();
-    }
-#else
-    ;
-#endif
+    // Returns the entry for 'type' in 'types', adding it if it's not there
+    // yet. Types that were registered before are found by their components,
+    // without formatting them with toString().
+    static Type* registerType(const Type& type);
+
+    // Rebuilds the index used by registerType() from 'types', which has to
+    // be done when the registry was filled without it, e.g. by loadModel().
+    static void reindex();
+
+    // Adds the index used by registerType() to the memory report.
+    static void addKeysToMemoryReport();
+
+    // Heap usage of the out-of-line part, without the data it owns.
+    qint64 extraSize() const;
 
     static const Type* Void;
 
+    enum { MaxConstPointers = 16 };
+
 protected:
+    // Most types are plain scalars or classes. Template arguments, array
+    // lengths and function pointer parameters are kept out of line and only
+    // allocated for the types that have them.
+    struct Extra;
+
+    Extra* extra();
+
+    void invalidateString() { m_stringRevision = 0; }
+
     Class* m_class;
     Typedef* m_typedef;
     Enum* m_enum;
-    QString m_name;
-    bool m_isConst, m_isVolatile;
-    int m_pointerDepth;
-    QHash<int, bool> m_constPointer;
-    bool m_isRef;
-    bool m_isIntegral;
-    QList<Type> m_templateArgs;
-    bool m_isFunctionPointer;
-    ParameterList m_params;
-    QVector<int> m_arrayLengths;
+    Symbol m_name;
+    uint m_isConst : 1;
+    uint m_isVolatile : 1;
+    uint m_isRef : 1;
+    uint m_isIntegral : 1;
+    uint m_isFunctionPointer : 1;
+    uint m_pointerDepth : 11;
+    // bit n is set if the pointer at depth n is const
+    uint m_constPointer : MaxConstPointers;
+    // the BasicTypeDeclaration::namesRevision m_string was built in, or 0
+    mutable uint m_stringRevision;
+    Extra* m_extra;
+    mutable QString m_string;
+
+private:
+    QString format(const QString& fnPtrName, bool prepend) const;
+
+    // Appends the class, typedef, enum or name, the qualifiers and
+    // recursively the template arguments and parameters to 'key'.
+    void appendKey(QVector<quintptr>& key) const;
 };
 
 #endif // TYPE_H